@@ -13,8 +13,8 @@ class Project(ConanFile):
     generators = "CMakeDeps", "CMakeToolchain"
     exports_sources = "conanfile.py", "CMakeLists.txt", "src/*"
     requires = [
-        "libzippp/7.1-1.10.1",
-        "nlohmann_json/3.12.0"
+        "nlohmann_json/3.12.0",
+        "zlib/1.3.1"
     ]
 
     keep_imports = True
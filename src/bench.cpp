@@ -0,0 +1,256 @@
+#include "board_generator.hpp"
+#include "excellon.hpp"
+#include "footprints.hpp"
+#include "kicad.hpp"
+#include "mapped_file.hpp"
+#include "stats.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+
+using namespace kicad;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Result {
+    size_t tokenCount;
+    size_t checksum;
+};
+
+// tokenize all data and return the number of tokens and a checksum of the token lengths
+Result tokenize(std::string_view data) {
+    Tokenizer t(data);
+    Result result = {};
+    while (true) {
+        auto token = t.getToken();
+        if (token == Token::FILE_END)
+            break;
+        ++result.tokenCount;
+        switch (token) {
+        case Token::CONTAINER:
+            result.checksum += t.readContainer().size();
+            break;
+        case Token::CONTAINER_END:
+            t.readContainerEnd();
+            break;
+        default:
+            result.checksum += t.readString().size();
+        }
+    }
+    return result;
+}
+
+// count the nodes (containers and values) of a tree
+size_t countNodes(Container &container) {
+    container.expand();
+    size_t count = 1;
+    for (auto element : container.elements) {
+        if (auto child = element->asContainer())
+            count += countNodes(*child);
+        else
+            ++count;
+    }
+    return count;
+}
+
+// look up what the output generators need from each footprint, returns a checksum
+size_t find(Container &board) {
+    size_t checksum = 0;
+    for (auto footprint : board.select(Atom::FOOTPRINT)) {
+        auto at = footprint->findNumber2(Atom::AT);
+        checksum += size_t(at.x + at.y);
+        checksum += footprint->findString(Atom::LAYER).size();
+        for (auto property : footprint->select(Atom::PROPERTY)) {
+            if (property->getString(0) == "Reference")
+                checksum += property->getString(1).size();
+        }
+        for (auto pad : footprint->select(Atom::PAD)) {
+            if (pad->find(Atom::DRILL) != nullptr)
+                ++checksum;
+        }
+    }
+    return checksum;
+}
+
+// stream buffer that only counts the bytes written to it
+class CountingBuffer : public std::streambuf {
+public:
+    size_t size = 0;
+
+protected:
+    int_type overflow(int_type c) override {
+        ++this->size;
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize count) override {
+        this->size += size_t(count);
+        return count;
+    }
+};
+
+// group the footprints like the BOMs of bom-tool and format the designators, returns the number of output bytes
+size_t groupBom(const FootprintTable &footprints) {
+    size_t size = 0;
+    for (auto format : {BomFormat::GENERIC, BomFormat::JLCPCB}) {
+        for (auto &group : kicad::groupBom(footprints, format))
+            size += compressDesignators(group.designators).size();
+    }
+    return size;
+}
+
+template <typename F>
+double measure(int repeat, const F &function) {
+    double best = 1e30;
+    for (int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+// print a throughput line, e.g. "parse: 250 MB/s, 40 Mnodes/s"
+void print(std::string_view name, double time, size_t bytes, size_t nodeCount) {
+    std::cout << std::left << std::setw(16) << std::string(name) + ':' << std::right << std::fixed
+        << std::setprecision(3) << std::setw(10) << time * 1000.0 << " ms " << std::setprecision(1)
+        << std::setw(8) << bytes / time / 1000000.0 << " MB/s " << std::setw(8) << nodeCount / time / 1000000.0
+        << " Mnodes/s" << std::endl;
+}
+
+// run all benchmarks on a file
+bool benchmark(const fs::path &path, int repeat) {
+    const char *modeNames[] = {"scalar", "SSE2", "AVX2"};
+    bool error = false;
+
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Error: Can't read file " << path.string() << std::endl;
+        return false;
+    }
+    auto data = file.data();
+
+    // count nodes
+    Document document;
+    readFile(path, document);
+    size_t nodeCount = countNodes(document.root);
+    std::cout << "*** " << path.string() << " (" << data.size() / 1000000.0 << " MB, " << nodeCount << " nodes) ***"
+        << std::endl;
+
+    // tokenize with all supported scan modes
+    Result reference = {};
+    for (int m = 0; m <= int(getMaxScanMode()); ++m) {
+        auto mode = ScanMode(m);
+        setScanMode(mode);
+        Result result;
+        double time = measure(repeat, [&] {result = tokenize(data);});
+        print(std::string("tokenize ") + modeNames[m], time, data.size(), nodeCount);
+
+        // check that all modes produce the same tokens
+        if (mode == ScanMode::SCALAR) {
+            reference = result;
+        } else if (result.tokenCount != reference.tokenCount || result.checksum != reference.checksum) {
+            std::cerr << "Error: " << modeNames[m] << " tokens differ from scalar tokens" << std::endl;
+            error = true;
+        }
+    }
+    setScanMode(ScanMode::SSE2);
+
+    // parse into a tree
+    double time = measure(repeat, [&] {readFile(path, document);});
+    print("parse", time, data.size(), nodeCount);
+    time = measure(repeat, [&] {readFile(path, document, {.threadCount = 0});});
+    print("parse parallel", time, data.size(), nodeCount);
+
+    // find footprint attributes, the first access builds the index of the root container
+    size_t checksum = 0;
+    time = measure(repeat, [&] {checksum += find(document.root);});
+    print("find", time, data.size(), nodeCount);
+
+    // write the tree
+    CountingBuffer buffer;
+    std::ostream s(&buffer);
+    time = measure(repeat, [&] {writeFile(s, document.root);});
+    print("write", time, data.size(), nodeCount);
+
+    // output generators
+    FootprintTable footprints;
+    time = measure(repeat, [&] {footprints = {}; footprints.build(document.root);});
+    print("footprints", time, data.size(), nodeCount);
+    time = measure(repeat, [&] {checksum += groupBom(footprints);});
+    print("bom", time, data.size(), nodeCount);
+    int skippedViaCount;
+    time = measure(repeat, [&] {checksum += getDrillHoles(footprints, document.root, skippedViaCount).size();});
+    print("drill", time, data.size(), nodeCount);
+
+    auto stats = getStats(document);
+    std::cout << "footprints: " << footprints.size() << ", pads: " << footprints.padNames.size()
+        << ", tree heap: " << stats.arenaBytes / 1000000 << " MB, peak memory: " << getPeakMemory() / 1000000
+        << " MB (checksum " << checksum % 1000 << ")" << std::endl;
+    return !error;
+}
+
+} // namespace
+
+
+/// @brief Benchmark for the kicad file parser and the output generators
+///
+/// Usage:
+/// bom-tool-bench <paths to .kicad_pcb files>
+/// bom-tool-bench --synthetic [max node count]
+/// bom-tool-bench --generate <node count> <path>
+///
+/// Options:
+///   --synthetic Benchmark synthetic boards with 1k, 10k, ... nodes up to the given count (default 10M). The boards
+///       get written to the temp directory and deleted afterwards
+///   --generate Write a synthetic board with approximately the given number of nodes
+int main(int argc, const char **argv) {
+    bool error = false;
+    if (argc >= 2 && std::string_view(argv[1]) == "--generate") {
+        // write synthetic board
+        if (argc != 4) {
+            std::cerr << "Usage: bom-tool-bench --generate <node count> <path>" << std::endl;
+            return 1;
+        }
+        std::ofstream s(argv[3], std::ios::binary);
+        size_t nodeCount = generateBoard(s, getBoardSize(std::stoull(argv[2])));
+        s.close();
+        if (s.fail()) {
+            std::cerr << "Error: Can't write file " << argv[3] << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << nodeCount << " nodes to " << argv[3] << std::endl;
+    } else if (argc >= 2 && std::string_view(argv[1]) == "--synthetic") {
+        // benchmark synthetic boards of increasing size
+        size_t maxNodeCount = argc >= 3 ? std::stoull(argv[2]) : 10000000;
+        fs::path path = fs::temp_directory_path() / "bom-tool-bench.kicad_pcb";
+        for (size_t nodeCount = 1000; nodeCount <= maxNodeCount; nodeCount *= 10) {
+            {
+                std::ofstream s(path, std::ios::binary);
+                generateBoard(s, getBoardSize(nodeCount));
+            }
+
+            // repeat small boards more often to reduce noise
+            int repeat = nodeCount <= 100000 ? 20 : 3;
+            if (!benchmark(path, repeat))
+                error = true;
+        }
+        fs::remove(path);
+    } else {
+        for (int i = 1; i < argc; ++i) {
+            if (!benchmark(argv[i], 5))
+                error = true;
+        }
+    }
+    return error ? 1 : 0;
+}
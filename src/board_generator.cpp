@@ -0,0 +1,500 @@
+#include "board_generator.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace kicad {
+
+namespace {
+
+// deterministic random number generator (SplitMix64), the standard distributions differ between implementations
+class Random {
+public:
+    Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (this->state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // random number from 0 to count - 1
+    int get(int count) {return int(next() % uint64_t(count));}
+
+    // select a random element
+    template <typename T, size_t N>
+    const T &select(const std::array<T, N> &array) {return array[get(int(N))];}
+
+protected:
+    uint64_t state;
+};
+
+// writes s-expressions formatted like KiCad and counts the nodes
+class Writer {
+public:
+    Writer(std::ostream *s) : s(s) {}
+    ~Writer() {flush();}
+
+    // begin a container, containers up to depth 2 (e.g. footprint properties) start on a new line
+    void begin(std::string_view id) {
+        int depth = int(this->multiLine.size());
+        if (depth > 0 && depth <= 2) {
+            this->buffer += '\n';
+            this->buffer.append(depth, '\t');
+            this->multiLine.back() = true;
+        } else if (depth > 0) {
+            this->buffer += ' ';
+        }
+        this->buffer += '(';
+        this->buffer += id;
+        this->multiLine.push_back(false);
+        ++this->nodeCount;
+    }
+
+    void end() {
+        if (this->multiLine.back()) {
+            this->buffer += '\n';
+            this->buffer.append(this->multiLine.size() - 1, '\t');
+        }
+        this->buffer += ')';
+        this->multiLine.pop_back();
+        if (this->multiLine.empty())
+            this->buffer += '\n';
+        if (this->buffer.size() > 1024 * 1024)
+            flush();
+    }
+
+    // add an unquoted value, e.g. smd
+    void value(std::string_view value) {
+        this->buffer += ' ';
+        this->buffer += value;
+        ++this->nodeCount;
+    }
+
+    // add a quoted string
+    void string(std::string_view value) {
+        this->buffer += " \"";
+        this->buffer += value;
+        this->buffer += '"';
+        ++this->nodeCount;
+    }
+
+    // add an integer
+    void number(int64_t value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        this->value({buffer, size_t(result.ptr - buffer)});
+    }
+
+    // add a length in µm as mm without trailing zeros
+    void mm(int64_t um) {
+        char buffer[32];
+        bool negative = um < 0;
+        uint64_t u = negative ? uint64_t(-um) : uint64_t(um);
+        int length = std::snprintf(buffer, sizeof(buffer), "%s%llu.%03llu", negative ? "-" : "",
+            (unsigned long long)(u / 1000), (unsigned long long)(u % 1000));
+        while (buffer[length - 1] == '0')
+            --length;
+        if (buffer[length - 1] == '.')
+            --length;
+        this->value({buffer, size_t(length)});
+    }
+
+    // add a container with one value, e.g. (layer "F.Cu")
+    void string(std::string_view id, std::string_view value) {
+        begin(id);
+        string(value);
+        end();
+    }
+
+    // add a container with one or more lengths, e.g. (at 10 20)
+    template <typename ...T>
+    void mm(std::string_view id, T ...values) {
+        begin(id);
+        (mm(int64_t(values)), ...);
+        end();
+    }
+
+    // add a uuid, generated from a counter
+    void uuid() {
+        char buffer[48];
+        std::snprintf(buffer, sizeof(buffer), "00000000-0000-4000-8000-%012llx",
+            (unsigned long long)++this->uuidCount);
+        string("uuid", buffer);
+    }
+
+    void flush() {
+        if (this->s != nullptr)
+            this->s->write(this->buffer.data(), this->buffer.size());
+        this->buffer.clear();
+    }
+
+    size_t nodeCount = 0;
+
+protected:
+    std::ostream *s;
+    std::string buffer;
+
+    // for each open container if it contains containers on separate lines
+    std::vector<bool> multiLine;
+
+    uint64_t uuidCount = 0;
+};
+
+// kinds of footprints
+struct Part {
+    std::string_view prefix;
+    std::string_view footprint;
+    std::array<std::string_view, 6> values;
+};
+
+constexpr std::array<Part, 4> PASSIVES = {{
+    {"R", "Resistor_SMD:R_0603_1608Metric", {"100", "1k", "4k7", "10k", "47k", "100k"}},
+    {"C", "Capacitor_SMD:C_0402_1005Metric", {"100n", "1u", "10n", "22p", "4u7", "10u"}},
+    {"L", "Inductor_SMD:L_0805_2012Metric", {"1u", "2u2", "4u7", "10u", "22u", "47u"}},
+    {"D", "LED_SMD:LED_0603_1608Metric", {"red", "green", "blue", "yellow", "white", "orange"}},
+}};
+
+constexpr std::array<int, 6> IC_PAD_COUNTS = {8, 14, 16, 20, 32, 48};
+
+// write a pad
+void writePad(Writer &w, Random &random, int number, bool throughHole, int64_t x, int64_t y, int rotation,
+    bool bottom, size_t netCount)
+{
+    w.begin("pad");
+    w.string(std::to_string(number));
+    if (throughHole) {
+        bool oval = number % 4 == 0;
+        w.value("thru_hole");
+        w.value(oval ? "oval" : number == 1 ? "rect" : "circle");
+        w.mm("at", x, y, rotation * 1000);
+        w.mm("size", 1700, oval ? 2500 : 1700);
+        w.begin("drill");
+        if (oval) {
+            w.value("oval");
+            w.mm(1000);
+            w.mm(1800);
+        } else {
+            w.mm(1000);
+        }
+        w.end();
+        w.begin("layers");
+        w.string("*.Cu");
+        w.string("*.Mask");
+        w.end();
+    } else {
+        w.value("smd");
+        w.value("roundrect");
+        w.mm("at", x, y, rotation * 1000);
+        w.mm("size", 800, 950);
+        w.begin("layers");
+        w.string(bottom ? "B.Cu" : "F.Cu");
+        w.string(bottom ? "B.Paste" : "F.Paste");
+        w.string(bottom ? "B.Mask" : "F.Mask");
+        w.end();
+    }
+    size_t net = 1 + size_t(random.next() % netCount);
+    w.begin("net");
+    w.number(int64_t(net));
+    w.string("N" + std::to_string(net));
+    w.end();
+    w.uuid();
+    w.end();
+}
+
+// write a property of a footprint, e.g. (property "Reference" "R1" (at 0 -1.43 0) (layer "F.SilkS"))
+void writeProperty(Writer &w, std::string_view name, std::string_view value, int64_t y, bool bottom) {
+    w.begin("property");
+    w.string(name);
+    w.string(value);
+    w.mm("at", 0, y, 0);
+    w.string("layer", bottom ? "B.Fab" : "F.Fab");
+    w.end();
+}
+
+// write a footprint: a passive, an IC, a connector or a mounting hole
+void writeFootprint(Writer &w, Random &random, size_t index, size_t netCount, std::array<size_t, 128> &counts) {
+    int kind = random.get(100);
+    bool bottom = random.get(5) == 0;
+    int rotation = random.get(4) * 90;
+
+    // place footprints on a grid with 5 mm pitch
+    int64_t x = int64_t(index % 1000) * 5000 + 10000;
+    int64_t y = int64_t(index / 1000) * 5000 + 10000;
+
+    std::string_view prefix;
+    std::string footprint;
+    std::string value;
+    std::string lcscPn;
+    int padCount;
+    bool throughHole = false;
+    if (kind < 75) {
+        // passive with two pads
+        auto &part = random.select(PASSIVES);
+        int v = random.get(int(part.values.size()));
+        prefix = part.prefix;
+        footprint = part.footprint;
+        value = part.values[v];
+        lcscPn = "C" + std::to_string(1000 + (&part - PASSIVES.data()) * 10 + v);
+        padCount = 2;
+    } else if (kind < 90) {
+        // IC
+        padCount = random.select(IC_PAD_COUNTS);
+        prefix = "U";
+        footprint = "Package_SO:SOIC-" + std::to_string(padCount);
+        value = "IC" + std::to_string(padCount) + "-" + std::to_string(random.get(8));
+        lcscPn = "C" + std::to_string(2000 + padCount * 10 + random.get(8));
+    } else if (kind < 98) {
+        // pin header
+        padCount = 2 + random.get(9);
+        prefix = "J";
+        footprint = "Connector_PinHeader_2.54mm:PinHeader_1x" + std::to_string(padCount);
+        value = "Conn_01x" + std::to_string(padCount);
+        throughHole = true;
+    } else {
+        // mounting hole
+        padCount = 0;
+        prefix = "H";
+        footprint = "MountingHole:MountingHole_3.2mm_M3";
+        value = "MountingHole";
+    }
+    size_t &count = counts[size_t(prefix[0])];
+    std::string reference = std::string(prefix) + std::to_string(++count);
+
+    w.begin("footprint");
+    w.string(footprint);
+    w.string("layer", bottom ? "B.Cu" : "F.Cu");
+    w.uuid();
+    if (rotation != 0)
+        w.mm("at", x, y, rotation * 1000);
+    else
+        w.mm("at", x, y);
+    writeProperty(w, "Reference", reference, -1430, bottom);
+    writeProperty(w, "Value", value, 1430, bottom);
+    if (!lcscPn.empty())
+        writeProperty(w, "LCSC PN", lcscPn, 0, bottom);
+
+    w.begin("attr");
+    if (padCount == 0) {
+        w.value("exclude_from_pos_files");
+        w.value("exclude_from_bom");
+    } else {
+        w.value(throughHole ? "through_hole" : "smd");
+        if (random.get(50) == 0)
+            w.value("dnp");
+    }
+    w.end();
+
+    if (padCount == 0) {
+        // non-plated hole
+        w.begin("pad");
+        w.string("");
+        w.value("np_thru_hole");
+        w.value("circle");
+        w.mm("at", 0, 0);
+        w.mm("size", 3200, 3200);
+        w.mm("drill", 3200);
+        w.begin("layers");
+        w.string("*.Cu");
+        w.string("*.Mask");
+        w.end();
+        w.uuid();
+        w.end();
+    } else if (padCount == 2 && !throughHole) {
+        writePad(w, random, 1, false, -825, 0, rotation, bottom, netCount);
+        writePad(w, random, 2, false, 825, 0, rotation, bottom, netCount);
+    } else {
+        // two rows for ICs, one row for connectors
+        int rowLength = throughHole ? padCount : padCount / 2;
+        for (int i = 0; i < padCount; ++i) {
+            int64_t px = throughHole ? 0 : (i < rowLength ? -2700 : 2700);
+            int64_t py = int64_t(i % rowLength) * (throughHole ? 2540 : 1270);
+            writePad(w, random, i + 1, throughHole, px, py, rotation, bottom, netCount);
+        }
+    }
+    w.end();
+}
+
+// write the board
+size_t generate(std::ostream *s, const BoardSize &size, uint64_t seed) {
+    Random random(seed);
+    Writer w(s);
+    size_t netCount = std::max(size.netCount, size_t(1));
+
+    w.begin("kicad_pcb");
+    w.begin("version");
+    w.value("20240108");
+    w.end();
+    w.string("generator", "bom-tool-bench");
+    w.begin("general");
+    w.mm("thickness", 1600);
+    w.end();
+    w.string("paper", "A4");
+    w.begin("title_block");
+    w.string("title", "Synthetic");
+    w.string("rev", "1.0");
+    w.end();
+
+    // layers
+    constexpr std::array<std::string_view, 8> LAYERS = {
+        "F.Cu", "B.Cu", "B.Paste", "F.Paste", "B.SilkS", "F.SilkS", "B.Mask", "F.Mask"};
+    constexpr std::array<int, 8> LAYER_NUMBERS = {0, 31, 34, 35, 36, 37, 38, 39};
+    w.begin("layers");
+    for (size_t i = 0; i < LAYERS.size(); ++i) {
+        w.begin(std::to_string(LAYER_NUMBERS[i]));
+        w.string(LAYERS[i]);
+        w.value(i < 2 ? "signal" : "user");
+        w.end();
+    }
+    w.begin("44");
+    w.string("Edge.Cuts");
+    w.value("user");
+    w.end();
+    w.end();
+
+    w.begin("setup");
+    w.mm("pad_to_mask_clearance", 0);
+    w.begin("pcbplotparams");
+    w.string("outputdirectory", "gerber/");
+    w.end();
+    w.end();
+
+    // nets
+    w.begin("net");
+    w.number(0);
+    w.string("");
+    w.end();
+    for (size_t i = 1; i <= netCount; ++i) {
+        w.begin("net");
+        w.number(int64_t(i));
+        w.string("N" + std::to_string(i));
+        w.end();
+    }
+
+    // footprints
+    std::array<size_t, 128> counts = {};
+    for (size_t i = 0; i < size.footprintCount; ++i)
+        writeFootprint(w, random, i, netCount, counts);
+
+    // tracks between random grid points
+    int64_t width = int64_t(std::min(size.footprintCount, size_t(1000))) * 5000 + 20000;
+    int64_t height = int64_t(size.footprintCount / 1000 + 1) * 5000 + 20000;
+    for (size_t i = 0; i < size.trackCount; ++i) {
+        int64_t x = int64_t(random.next() % uint64_t(width));
+        int64_t y = int64_t(random.next() % uint64_t(height));
+        bool horizontal = random.get(2) == 0;
+        int64_t length = 1000 + random.get(20000);
+        w.begin("segment");
+        w.mm("start", x, y);
+        w.mm("end", horizontal ? x + length : x, horizontal ? y : y + length);
+        w.mm("width", random.get(4) == 0 ? 500 : 250);
+        w.string("layer", random.get(2) == 0 ? "F.Cu" : "B.Cu");
+        w.begin("net");
+        w.number(int64_t(1 + random.next() % netCount));
+        w.end();
+        w.uuid();
+        w.end();
+    }
+
+    // vias
+    for (size_t i = 0; i < size.viaCount; ++i) {
+        w.begin("via");
+        w.mm("at", random.next() % uint64_t(width), random.next() % uint64_t(height));
+        w.mm("size", 600);
+        w.mm("drill", 300);
+        w.begin("layers");
+        w.string("F.Cu");
+        w.string("B.Cu");
+        w.end();
+        w.begin("net");
+        w.number(int64_t(1 + random.next() % netCount));
+        w.end();
+        w.uuid();
+        w.end();
+    }
+
+    // zones with a rectangular outline and a filled polygon that approximates a circle
+    for (size_t i = 0; i < size.zoneCount; ++i) {
+        size_t net = 1 + random.next() % netCount;
+        bool bottom = i % 2 == 1;
+        int64_t radius = 5000 + random.get(20000);
+        int64_t x0 = radius + int64_t(random.next() % uint64_t(width));
+        int64_t y0 = radius + int64_t(random.next() % uint64_t(height));
+        w.begin("zone");
+        w.begin("net");
+        w.number(int64_t(net));
+        w.end();
+        w.string("net_name", "N" + std::to_string(net));
+        w.string("layer", bottom ? "B.Cu" : "F.Cu");
+        w.uuid();
+        w.begin("polygon");
+        w.begin("pts");
+        w.mm("xy", x0 - radius, y0 - radius);
+        w.mm("xy", x0 + radius, y0 - radius);
+        w.mm("xy", x0 + radius, y0 + radius);
+        w.mm("xy", x0 - radius, y0 + radius);
+        w.end();
+        w.end();
+        w.begin("filled_polygon");
+        w.string("layer", bottom ? "B.Cu" : "F.Cu");
+        w.begin("pts");
+        for (size_t j = 0; j < size.zonePointCount; ++j) {
+            // walk around the outline with some jitter
+            int64_t t = int64_t(j * 8000 / std::max(size.zonePointCount, size_t(1)));
+            int64_t side = t / 2000;
+            int64_t d = (t % 2000) * radius / 1000 - radius;
+            int64_t jitter = random.get(500);
+            int64_t px = side == 0 ? d : side == 1 ? radius - jitter : side == 2 ? -d : -radius + jitter;
+            int64_t py = side == 0 ? -radius + jitter : side == 1 ? d : side == 2 ? radius - jitter : -d;
+            w.mm("xy", x0 + px, y0 + py);
+        }
+        w.end();
+        w.end();
+        w.end();
+    }
+
+    w.begin("gr_rect");
+    w.mm("start", 0, 0);
+    w.mm("end", width + 50000, height + 50000);
+    w.string("layer", "Edge.Cuts");
+    w.end();
+
+    w.end();
+    return w.nodeCount;
+}
+
+// proportions of a typical board relative to the number of footprints
+BoardSize getProportions(size_t footprintCount) {
+    size_t zoneCount = footprintCount / 200 + 1;
+    return {
+        footprintCount,
+        footprintCount / 3 + 1,
+        footprintCount * 4,
+        footprintCount / 2,
+        zoneCount,
+        std::min(footprintCount * 2 / zoneCount + 8, size_t(2000))};
+}
+
+} // anonymous namespace
+
+
+BoardSize getBoardSize(size_t nodeCount) {
+    // count the nodes of a board with 1000 footprints and scale it
+    constexpr size_t REFERENCE_COUNT = 1000;
+    size_t base = generate(nullptr, getProportions(0), 1);
+    size_t reference = generate(nullptr, getProportions(REFERENCE_COUNT), 1);
+    size_t footprintCount = nodeCount > base ? (nodeCount - base) * REFERENCE_COUNT / (reference - base) : 0;
+    return getProportions(std::max(footprintCount, size_t(1)));
+}
+
+size_t generateBoard(std::ostream &s, const BoardSize &size, uint64_t seed) {
+    return generate(&s, size, seed);
+}
+
+} // namespace kicad
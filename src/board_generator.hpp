@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+
+namespace kicad {
+
+/// @brief Number of top level elements of a synthetic board
+///
+struct BoardSize {
+    // footprints, a mix of two pad SMD parts, ICs and through hole connectors
+    size_t footprintCount;
+
+    // nets (net 1 "N1")
+    size_t netCount;
+
+    // tracks (segment)
+    size_t trackCount;
+
+    // through vias
+    size_t viaCount;
+
+    // filled zones
+    size_t zoneCount;
+
+    // points of the filled polygon of each zone
+    size_t zonePointCount;
+};
+
+/// @brief Get a board size with typical proportions and approximately the given number of nodes (containers and
+/// values)
+/// @param nodeCount Number of nodes, e.g. 1000 to 10000000
+/// @return Board size
+BoardSize getBoardSize(size_t nodeCount);
+
+/// @brief Write a synthetic .kicad_pcb file for benchmarks. The board only depends on size and seed, so that results
+/// can be compared across runs and machines
+/// @param s Output stream
+/// @param size Board size
+/// @param seed Seed of the random number generator
+/// @return Number of nodes (containers and values) that were written
+size_t generateBoard(std::ostream &s, const BoardSize &size, uint64_t seed = 1);
+
+} // namespace kicad
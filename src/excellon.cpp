@@ -0,0 +1,221 @@
+#include "excellon.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numbers>
+#include <string>
+#include <tuple>
+
+
+namespace kicad {
+
+namespace {
+
+// convert mm to nm
+inline int64_t toNm(double mm) {
+    return std::llround(mm * 1e6);
+}
+
+// rotate a point around the origin like KiCad (y-axis points down)
+void rotate(int64_t &x, int64_t &y, double rotation) {
+    double r = rotation * std::numbers::pi / 180.0;
+    double s = std::sin(r);
+    double c = std::cos(r);
+    double rx = double(x) * c + double(y) * s;
+    double ry = double(y) * c - double(x) * s;
+    x = std::llround(rx);
+    y = std::llround(ry);
+}
+
+// append a number in mm with three decimals and without trailing zeros, but keep one zero after the decimal point
+void appendNumber(std::string &line, int64_t nm) {
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.3f", double(nm) * 1e-6);
+    while (buffer[length - 1] == '0')
+        --length;
+    if (buffer[length - 1] == '.')
+        buffer[length++] = '0';
+    line.append(buffer, length);
+}
+
+// append coordinates, the y-axis of Excellon points up
+void appendCoordinates(std::string &line, int64_t x, int64_t y) {
+    line += 'X';
+    appendNumber(line, x);
+    line += 'Y';
+    appendNumber(line, -y);
+}
+
+} // anonymous namespace
+
+
+std::vector<DrillHole> getDrillHoles(const FootprintTable &footprints, Container &board, int &skippedViaCount) {
+    std::vector<DrillHole> holes;
+
+    // pads
+    for (size_t i = 0; i < footprints.size(); ++i) {
+        double r = footprints.rotations[i] * std::numbers::pi / 180.0;
+        double s = std::sin(r);
+        double c = std::cos(r);
+        for (uint32_t pad = footprints.padBegin[i]; pad < footprints.padBegin[i + 1]; ++pad) {
+            auto type = footprints.padTypes[pad];
+            bool plated = type == "thru_hole";
+            if ((!plated && type != "np_thru_hole") || footprints.drillWidths[pad] <= 0.0)
+                continue;
+
+            // transform to global coordinates, the drill offset moves the pad shape, not the hole
+            double x = footprints.padX[pad];
+            double y = footprints.padY[pad];
+            holes.push_back({
+                toNm(footprints.positionX[i] + c * x + s * y),
+                toNm(footprints.positionY[i] + c * y - s * x),
+                toNm(footprints.drillWidths[pad]),
+                toNm(footprints.drillHeights[pad]),
+                footprints.padRotations[pad],
+                plated ? DrillHole::PAD : DrillHole::MECHANICAL});
+        }
+    }
+
+    // vias: (via (at 10 20) (size 0.6) (drill 0.3) (layers "F.Cu" "B.Cu") ...), the type and flags precede the
+    // containers, e.g. (via blind ...), (via micro ...) or (via locked ...)
+    skippedViaCount = 0;
+    for (auto via : board.select(Atom::VIA)) {
+        bool throughVia = true;
+        via->expand();
+        for (auto element : via->elements) {
+            auto value = element->asValue();
+            if (value == nullptr)
+                break;
+            if (value->value == "blind" || value->value == "micro")
+                throughVia = false;
+        }
+        if (!throughVia) {
+            // blind or micro via that would require a drill file per layer pair
+            ++skippedViaCount;
+            continue;
+        }
+        auto at = via->findNumber2(Atom::AT);
+        auto drill = via->find(Atom::DRILL);
+        if (drill == nullptr)
+            continue;
+        int64_t diameter = toNm(drill->getNumber(0));
+        holes.push_back({toNm(at.x), toNm(at.y), diameter, diameter, 0.0, DrillHole::VIA});
+    }
+
+    std::ranges::sort(holes, {}, [](const DrillHole &hole) {
+        return std::tuple(!hole.plated(), hole.diameter(), hole.type, hole.x, hole.y);
+    });
+    return holes;
+}
+
+bool writeExcellon(const std::filesystem::path &path, std::span<const DrillHole> holes, bool plated,
+    int copperLayerCount, OvalFormat ovalFormat)
+{
+    // holes of the file and their tool numbers
+    auto begin = std::ranges::find_if(holes, [plated](const DrillHole &hole) {return hole.plated() == plated;});
+    auto end = std::find_if(begin, holes.end(), [plated](const DrillHole &hole) {return hole.plated() != plated;});
+    std::span<const DrillHole> fileHoles(begin, end);
+    std::vector<int> tools;
+    tools.reserve(fileHoles.size());
+
+    std::string out;
+    out += "M48\n"
+        "; DRILL file {bom-tool}\n"
+        "; FORMAT={-:-/ absolute / metric / decimal}\n"
+        "; #@! TF.GenerationSoftware,bom-tool\n";
+    out += "; #@! TF.FileFunction,";
+    out += plated ? "Plated" : "NonPlated";
+    out += ",1," + std::to_string(copperLayerCount) + (plated ? ",PTH\n" : ",NPTH\n");
+    out += "FMAT,2\n"
+        "METRIC\n";
+
+    // tool list, a new tool starts when diameter or type change
+    int toolCount = 0;
+    for (size_t i = 0; i < fileHoles.size(); ++i) {
+        auto &hole = fileHoles[i];
+        if (i == 0 || hole.diameter() != fileHoles[i - 1].diameter() || hole.type != fileHoles[i - 1].type) {
+            ++toolCount;
+            switch (hole.type) {
+            case DrillHole::VIA:
+                out += "; #@! TA.AperFunction,Plated,PTH,ViaDrill\n";
+                break;
+            case DrillHole::PAD:
+                out += "; #@! TA.AperFunction,Plated,PTH,ComponentDrill\n";
+                break;
+            case DrillHole::MECHANICAL:
+                out += "; #@! TA.AperFunction,NonPlated,NPTH,ComponentDrill\n";
+                break;
+            }
+            char buffer[48];
+            std::snprintf(buffer, sizeof(buffer), "T%dC%.3f\n", toolCount, double(hole.diameter()) * 1e-6);
+            out += buffer;
+        }
+        tools.push_back(toolCount);
+    }
+    out += "%\n"
+        "G90\n"
+        "G05\n";
+
+    // round holes
+    int tool = 0;
+    for (size_t i = 0; i < fileHoles.size(); ++i) {
+        auto &hole = fileHoles[i];
+        if (hole.oval())
+            continue;
+        if (tools[i] != tool) {
+            tool = tools[i];
+            out += 'T' + std::to_string(tool) + '\n';
+        }
+        appendCoordinates(out, hole.x, hole.y);
+        out += '\n';
+    }
+
+    // oval holes
+    tool = 0;
+    for (size_t i = 0; i < fileHoles.size(); ++i) {
+        auto &hole = fileHoles[i];
+        if (!hole.oval() || hole.diameter() == 0)
+            continue;
+        if (tools[i] != tool) {
+            tool = tools[i];
+            out += 'T' + std::to_string(tool) + '\n';
+        }
+
+        // start and end point of the slot along its longer axis
+        int64_t dx = 0;
+        int64_t dy = 0;
+        if (hole.width < hole.height)
+            dy = (hole.height - hole.width) / 2;
+        else
+            dx = (hole.width - hole.height) / 2;
+        rotate(dx, dy, hole.rotation);
+        int64_t x0 = hole.x - dx;
+        int64_t y0 = hole.y - dy;
+        int64_t x1 = hole.x + dx;
+        int64_t y1 = hole.y + dy;
+
+        if (ovalFormat == OvalFormat::ROUTE) {
+            out += "G00";
+            appendCoordinates(out, x0, y0);
+            out += "\nM15\nG01";
+            appendCoordinates(out, x1, y1);
+            out += "\nM16\n";
+        } else {
+            appendCoordinates(out, x0, y0);
+            out += "G85";
+            appendCoordinates(out, x1, y1);
+            out += '\n';
+        }
+        out += "G05\n";
+    }
+    out += "T0\n"
+        "M30\n";
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(out.data(), out.size());
+    file.close();
+    return !file.fail();
+}
+
+} // namespace kicad
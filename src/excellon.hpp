@@ -0,0 +1,69 @@
+#pragma once
+
+#include "footprints.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+
+namespace kicad {
+
+/// @brief Format of oval holes in Excellon files (--excellon-oval-format of kicad-cli)
+///
+enum class OvalFormat {
+    // route the slot (G00, M15, G01, M16)
+    ROUTE,
+
+    // drill the slot using G85
+    ALTERNATE
+};
+
+/// @brief Through hole of a pad or via in board coordinates (y-axis points down)
+///
+struct DrillHole {
+    // hole type, also used for sorting in the same order as KiCad
+    enum Type {
+        VIA,
+        PAD,
+        MECHANICAL
+    };
+
+    // position in nm
+    int64_t x;
+    int64_t y;
+
+    // size in nm, width and height differ for oval holes
+    int64_t width;
+    int64_t height;
+
+    // rotation in degrees
+    double rotation;
+
+    Type type;
+
+    bool plated() const {return this->type != MECHANICAL;}
+    int64_t diameter() const {return std::min(this->width, this->height);}
+    bool oval() const {return this->width != this->height;}
+};
+
+/// @brief Get all through holes of pads and vias, blind and micro vias are not included
+/// @param footprints Footprints of the board
+/// @param board Root container of a .kicad_pcb file
+/// @param skippedViaCount Receives the number of blind and micro vias that were skipped
+/// @return Holes sorted like in kicad-cli (plated first, then by diameter, type and position)
+std::vector<DrillHole> getDrillHoles(const FootprintTable &footprints, Container &board, int &skippedViaCount);
+
+/// @brief Write an Excellon drill file in the format of kicad-cli pcb export drill --excellon-separate-th, but
+/// without creation date so that the file only depends on the board
+/// @param path Path of the drill file, e.g. "board-PTH.drl"
+/// @param holes Holes sorted by getDrillHoles()
+/// @param plated Write the plated (PTH) or non-plated (NPTH) holes
+/// @param copperLayerCount Number of copper layers
+/// @param ovalFormat Format of oval holes
+/// @return true on success
+bool writeExcellon(const std::filesystem::path &path, std::span<const DrillHole> holes, bool plated,
+    int copperLayerCount, OvalFormat ovalFormat);
+
+} // namespace kicad
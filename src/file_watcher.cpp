@@ -0,0 +1,149 @@
+#include "file_watcher.hpp"
+#include <algorithm>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+// interval for checking polled files
+constexpr std::chrono::milliseconds POLL_INTERVAL(100);
+
+// maximum time to wait for a file that was modified and is still open, e.g. by a writer that keeps it open
+constexpr std::chrono::milliseconds MAX_WRITE_TIME(2000);
+
+} // anonymous namespace
+
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (this->fd >= 0)
+        close(this->fd);
+#endif
+}
+
+void FileWatcher::add(const std::filesystem::path &path) {
+    File file = {path, path.filename().string(), -1, false, {}, -1};
+#ifdef __linux__
+    if (this->fd >= 0) {
+        // watch the directory for files that were written or renamed to the file name, adding the same directory again
+        // returns the same watch descriptor. Modifications restart the debounce time while a file is being written
+        auto directory = path.parent_path();
+        if (directory.empty())
+            directory = ".";
+        file.watch = inotify_add_watch(this->fd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+    update(file);
+    this->files.push_back(std::move(file));
+}
+
+std::vector<std::filesystem::path> FileWatcher::wait(std::chrono::milliseconds debounce) {
+    std::vector<bool> changed(this->files.size());
+
+    // wait for the first change
+    while (!check(POLL_INTERVAL, changed)) {
+    }
+
+    // wait until the files are quiet for the debounce time and all writes are complete, e.g. if a file gets
+    // truncated and then written. Files that stay open are considered complete after MAX_WRITE_TIME without changes
+    auto lastChange = std::chrono::steady_clock::now();
+    while (true) {
+        if (check(debounce, changed)) {
+            lastChange = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (std::ranges::none_of(this->files, [](const File &file) {return file.writing;}))
+            break;
+        if (std::chrono::steady_clock::now() - lastChange >= MAX_WRITE_TIME) {
+            for (auto &file : this->files)
+                file.writing = false;
+            break;
+        }
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for (size_t i = 0; i < this->files.size(); ++i) {
+        if (changed[i]) {
+            update(this->files[i]);
+            paths.push_back(this->files[i].path);
+        }
+    }
+    return paths;
+}
+
+bool FileWatcher::update(File &file) {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(file.path, ec);
+    intmax_t size = -1;
+    if (!ec)
+        size = intmax_t(std::filesystem::file_size(file.path, ec));
+    if (ec) {
+        time = {};
+        size = -1;
+    }
+    bool changed = time != file.time || size != file.size;
+    file.time = time;
+    file.size = size;
+    return changed;
+}
+
+bool FileWatcher::check(std::chrono::milliseconds timeout, std::vector<bool> &changed) {
+    bool result = false;
+#ifdef __linux__
+    if (this->fd >= 0) {
+        pollfd p = {this->fd, POLLIN, 0};
+        if (::poll(&p, 1, int(timeout.count())) > 0) {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(this->fd, buffer, sizeof(buffer))) > 0) {
+                for (char *e = buffer; e < buffer + length; ) {
+                    auto event = reinterpret_cast<inotify_event *>(e);
+                    for (size_t i = 0; i < this->files.size(); ++i) {
+                        auto &file = this->files[i];
+                        if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                            // events got lost, therefore assume that all files changed
+                            file.writing = false;
+                        } else if (event->wd != file.watch || event->len == 0 || file.name != event->name) {
+                            continue;
+                        } else {
+                            file.writing = (event->mask & IN_MODIFY) != 0;
+                        }
+                        changed[i] = true;
+                        result = true;
+                    }
+                    e += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+        bool polling = false;
+        for (auto &file : this->files)
+            polling |= file.watch < 0;
+        if (!polling)
+            return result;
+    } else
+#endif
+    {
+        std::this_thread::sleep_for(timeout);
+    }
+
+    // poll files that are not watched by inotify
+    for (size_t i = 0; i < this->files.size(); ++i) {
+        auto &file = this->files[i];
+        if (file.watch < 0 && update(file)) {
+            changed[i] = true;
+            result = true;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+/// @brief Watches files for changes. Uses inotify on Linux and polls the last write time and size of the files on
+/// other platforms or if inotify is not available
+class FileWatcher {
+public:
+    FileWatcher();
+    FileWatcher(const FileWatcher &) = delete;
+    ~FileWatcher();
+
+    /// @brief Add a file to watch, it does not need to exist yet. The directory of the file gets watched, therefore
+    /// files that get replaced by renaming a temporary file are detected as well
+    /// @param path Path of the file
+    void add(const std::filesystem::path &path);
+
+    /// @brief Wait until files change. Returns when no further change was detected for the debounce time and the
+    /// changed files were closed, so that saving several files or writing a file in several steps results in one call.
+    /// A file that stays open is considered complete after two seconds without changes
+    /// @param debounce Time without changes before returning
+    /// @return Paths of the changed files as passed to add()
+    std::vector<std::filesystem::path> wait(std::chrono::milliseconds debounce);
+
+    /// @brief Check if all files get polled
+    bool isPolling() const {return this->fd < 0;}
+
+protected:
+    struct File {
+        std::filesystem::path path;
+
+        // file name and watch descriptor of the directory, -1 if the file gets polled
+        std::string name;
+        int watch;
+
+        // file was modified but not closed yet
+        bool writing;
+
+        // last write time and size of the file when polling, size is -1 if the file does not exist
+        std::filesystem::file_time_type time;
+        intmax_t size;
+    };
+
+    // update the last write time and size, returns true if they changed
+    static bool update(File &file);
+
+    // wait at most the given time for changes and mark the changed files, returns true if a file changed
+    bool check(std::chrono::milliseconds timeout, std::vector<bool> &changed);
+
+    std::vector<File> files;
+
+    // inotify instance, -1 if not available
+    int fd = -1;
+};
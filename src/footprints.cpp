@@ -0,0 +1,373 @@
+#include "footprints.hpp"
+#include "hash.hpp"
+#include "string_pool.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+
+
+namespace kicad {
+
+namespace {
+
+// get a value without quotes, references the memory of the document
+std::string_view getView(Container *container, int index) {
+    auto value = container->getValue(index);
+    if (value == nullptr)
+        return {};
+    auto str = value->value;
+    if (str.size() >= 2 && str.front() == '"' && str.back() == '"')
+        return str.substr(1, str.size() - 2);
+    return str;
+}
+
+uint8_t getAttributes(Container *attr) {
+    uint8_t attributes = 0;
+    attr->expand();
+    for (auto element : attr->elements) {
+        auto value = element->asValue();
+        if (value == nullptr)
+            continue;
+        auto tag = value->value;
+        if (tag == "smd")
+            attributes |= FootprintTable::SMD;
+        else if (tag == "through_hole")
+            attributes |= FootprintTable::THROUGH_HOLE;
+        else if (tag == "board_only")
+            attributes |= FootprintTable::BOARD_ONLY;
+        else if (tag == "exclude_from_pos_files")
+            attributes |= FootprintTable::EXCLUDE_FROM_POS_FILES;
+        else if (tag == "exclude_from_bom")
+            attributes |= FootprintTable::EXCLUDE_FROM_BOM;
+        else if (tag == "dnp")
+            attributes |= FootprintTable::DNP;
+    }
+    return attributes;
+}
+
+// fields of a BOM group as indices into a StringPool
+struct BomKey {
+    uint32_t type;
+    uint32_t value;
+    int voltage;
+    uint32_t footprint;
+    uint32_t manufacturer;
+    uint32_t mpn;
+    uint32_t lcscPn;
+
+    bool operator ==(const BomKey &other) const noexcept = default;
+};
+
+// combine hash values
+inline size_t hashCombine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+struct BomKeyHash {
+    size_t operator ()(const BomKey &key) const noexcept {
+        size_t h = key.type;
+        h = hashCombine(h, key.value);
+        h = hashCombine(h, key.voltage);
+        h = hashCombine(h, key.footprint);
+        h = hashCombine(h, key.manufacturer);
+        h = hashCombine(h, key.mpn);
+        return hashCombine(h, key.lcscPn);
+    }
+};
+
+} // anonymous namespace
+
+
+std::string_view getType(std::string_view reference) {
+    size_t i = 0;
+    while (i < reference.length()) {
+        char ch = reference[i];
+        if (ch >= '0' && ch <= '9')
+            break;
+        ++i;
+    }
+    return reference.substr(0, i);
+}
+
+DesignatorKey getDesignatorKey(std::string_view designator) {
+    auto prefix = getType(designator);
+    auto digits = designator.substr(prefix.size());
+    uint64_t number = 0;
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+    if (result.ec == std::errc::result_out_of_range)
+        number = std::numeric_limits<uint64_t>::max();
+    return {prefix, number, designator};
+}
+
+std::string compressDesignators(std::span<const DesignatorKey> designators) {
+    // check if a designator consists of prefix and number only, e.g. "R10" but not "R10A" or "R010"
+    auto isPlain = [](const DesignatorKey &key) {
+        auto digits = key.designator.substr(key.prefix.size());
+        return !digits.empty() && digits.size() <= 18 && (digits[0] != '0' || digits.size() == 1)
+            && digits.find_first_not_of("0123456789") == std::string_view::npos;
+    };
+
+    std::string result;
+    size_t count = designators.size();
+    size_t i = 0;
+    while (i < count) {
+        // find run of consecutive numbers
+        size_t j = i + 1;
+        if (isPlain(designators[i])) {
+            while (j < count && isPlain(designators[j]) && designators[j].prefix == designators[i].prefix
+                && designators[j].number == designators[j - 1].number + 1)
+            {
+                ++j;
+            }
+        }
+
+        if (!result.empty())
+            result += ',';
+        if (j - i >= 3) {
+            result += designators[i].designator;
+            result += '-';
+            result += designators[j - 1].designator;
+        } else {
+            j = i + 1;
+            result += designators[i].designator;
+        }
+        i = j;
+    }
+    return result;
+}
+
+
+// FootprintTable
+
+size_t FootprintTable::build(Container &board, const FootprintTable *previous) {
+    // footprints of the previous table by hash of their text
+    std::unordered_map<uint64_t, size_t> previousIndices;
+    if (previous != nullptr) {
+        for (size_t i = 0; i < previous->size(); ++i) {
+            if (previous->textHashes[i] != 0)
+                previousIndices.emplace(previous->textHashes[i], i);
+        }
+    }
+
+    size_t copyCount = 0;
+    for (auto footprint : board.select(Atom::FOOTPRINT)) {
+        // copy the footprint if its text is unchanged, otherwise parse it
+        auto text = footprint->getDeferredText();
+        uint64_t textHash = footprint->getDeferredHash();
+        if (!text.empty()) {
+            auto it = previousIndices.find(textHash);
+            if (it != previousIndices.end() && previous->texts[it->second].size() == text.size()) {
+                copy(*previous, it->second, text);
+                ++copyCount;
+                continue;
+            }
+        }
+
+        // get footprint name and remove library
+        auto footprintName = getView(footprint, 0);
+        auto name = footprintName;
+        auto pos = name.find(':');
+        if (pos != std::string_view::npos)
+            name.remove_prefix(pos + 1);
+
+        std::string_view reference;
+        std::string_view value;
+        std::string_view layer;
+        double x = 0;
+        double y = 0;
+        double rotation = 0;
+        uint8_t attributes = 0;
+        for (auto element : *footprint) {
+            switch (element->atom) {
+            case Atom::AT:
+                x = element->getNumber(0);
+                y = element->getNumber(1);
+                rotation = element->getNumber(2);
+                break;
+            case Atom::LAYER:
+                layer = getView(element, 0);
+                break;
+            case Atom::PROPERTY: {
+                auto propertyName = getView(element, 0);
+                auto propertyValue = getView(element, 1);
+                if (propertyName == "Reference")
+                    reference = propertyValue;
+                else if (propertyName == "Value")
+                    value = propertyValue;
+                this->propertyNames.push_back(propertyName);
+                this->propertyValues.push_back(propertyValue);
+                break;
+            }
+            case Atom::ATTR:
+                attributes = getAttributes(element);
+                break;
+            case Atom::PAD: {
+                this->padNames.push_back(getView(element, 0));
+                this->padTypes.push_back(getView(element, 1));
+
+                auto at = element->find(Atom::AT);
+                this->padX.push_back(at != nullptr ? at->getNumber(0) : 0.0);
+                this->padY.push_back(at != nullptr ? at->getNumber(1) : 0.0);
+                this->padRotations.push_back(at != nullptr ? at->getNumber(2) : 0.0);
+
+                // (drill 1) or (drill oval 1 1.8), optionally followed by (offset x y)
+                double w = 0;
+                double h = 0;
+                auto drill = element->find(Atom::DRILL);
+                if (drill != nullptr) {
+                    if (getView(drill, 0) == "oval") {
+                        w = drill->getNumber(1);
+                        h = drill->getNumber(2);
+                    } else {
+                        w = h = drill->getNumber(0);
+                    }
+                }
+                this->drillWidths.push_back(w);
+                this->drillHeights.push_back(h);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        this->footprints.push_back(footprintName);
+        this->names.push_back(name);
+        this->references.push_back(reference);
+        this->values.push_back(value);
+        this->types.push_back(getType(reference));
+        this->layers.push_back(layer);
+        this->positionX.push_back(x);
+        this->positionY.push_back(y);
+        this->rotations.push_back(rotation);
+        this->attributes.push_back(attributes);
+        this->texts.push_back(text);
+        this->textHashes.push_back(textHash);
+        this->padBegin.push_back(uint32_t(this->padNames.size()));
+        this->propertyBegin.push_back(uint32_t(this->propertyNames.size()));
+    }
+    return copyCount;
+}
+
+uint64_t FootprintTable::getHash() const {
+    if (std::ranges::find(this->textHashes, 0) != this->textHashes.end())
+        return 0;
+    return hash64({reinterpret_cast<const char *>(this->textHashes.data()), this->textHashes.size() * sizeof(uint64_t)},
+        this->textHashes.size());
+}
+
+int FootprintTable::findProperty(size_t index, std::string_view name) const {
+    for (uint32_t i = this->propertyBegin[index]; i < this->propertyBegin[index + 1]; ++i) {
+        if (this->propertyNames[i] == name)
+            return int(i);
+    }
+    return -1;
+}
+
+void FootprintTable::copy(const FootprintTable &other, size_t index, std::string_view text) {
+    // the strings of a footprint that was parsed from its text reference the text, therefore move them to the same
+    // offset in the new text. Only addresses are compared, the old text does not get accessed
+    auto oldText = other.texts[index];
+    auto begin = reinterpret_cast<uintptr_t>(oldText.data());
+    auto relocate = [begin, &oldText, &text](std::string_view str) {
+        auto address = reinterpret_cast<uintptr_t>(str.data());
+        if (address < begin || address + str.size() > begin + oldText.size())
+            return str;
+        return text.substr(address - begin, str.size());
+    };
+
+    for (uint32_t i = other.padBegin[index]; i < other.padBegin[index + 1]; ++i) {
+        this->padNames.push_back(relocate(other.padNames[i]));
+        this->padTypes.push_back(relocate(other.padTypes[i]));
+        this->padX.push_back(other.padX[i]);
+        this->padY.push_back(other.padY[i]);
+        this->padRotations.push_back(other.padRotations[i]);
+        this->drillWidths.push_back(other.drillWidths[i]);
+        this->drillHeights.push_back(other.drillHeights[i]);
+    }
+    for (uint32_t i = other.propertyBegin[index]; i < other.propertyBegin[index + 1]; ++i) {
+        this->propertyNames.push_back(relocate(other.propertyNames[i]));
+        this->propertyValues.push_back(relocate(other.propertyValues[i]));
+    }
+
+    this->footprints.push_back(relocate(other.footprints[index]));
+    this->names.push_back(relocate(other.names[index]));
+    this->references.push_back(relocate(other.references[index]));
+    this->values.push_back(relocate(other.values[index]));
+    this->types.push_back(relocate(other.types[index]));
+    this->layers.push_back(relocate(other.layers[index]));
+    this->positionX.push_back(other.positionX[index]);
+    this->positionY.push_back(other.positionY[index]);
+    this->rotations.push_back(other.rotations[index]);
+    this->attributes.push_back(other.attributes[index]);
+    this->texts.push_back(text);
+    this->textHashes.push_back(other.textHashes[index]);
+    this->padBegin.push_back(uint32_t(this->padNames.size()));
+    this->propertyBegin.push_back(uint32_t(this->propertyNames.size()));
+}
+
+
+// BOM
+
+std::vector<BomGroup> groupBom(const FootprintTable &footprints, BomFormat format,
+    std::vector<uint32_t> *invalidVoltages)
+{
+    // group by string indices, the empty string is index 0
+    StringPool strings;
+    uint32_t empty = strings.add({});
+    std::unordered_map<BomKey, size_t, BomKeyHash> groupIndices;
+    std::vector<BomGroup> groups;
+    for (uint32_t i = 0; i < footprints.size(); ++i) {
+        if (footprints.has(i, FootprintTable::EXCLUDE_FROM_BOM)
+            || (format == BomFormat::JLCPCB && footprints.has(i, FootprintTable::DNP)))
+        {
+            continue;
+        }
+
+        BomKey key = {strings.add(footprints.types[i]), strings.add(footprints.values[i]), 0,
+            strings.add(footprints.names[i]), empty, empty, empty};
+        if (format == BomFormat::GENERIC) {
+            // operating voltage
+            int voltageProperty = footprints.findProperty(i, "Voltage");
+            if (voltageProperty >= 0) {
+                double v;
+                if (parseNumber(footprints.propertyValues[voltageProperty], v))
+                    key.voltage = int(std::lround(v * 1000.0));
+                else if (invalidVoltages != nullptr)
+                    invalidVoltages->push_back(i);
+            }
+            key.manufacturer = strings.add(footprints.getProperty(i, "Manufacturer"));
+            key.mpn = strings.add(footprints.getProperty(i, "MPN"));
+        } else {
+            key.lcscPn = strings.add(footprints.getProperty(i, "LCSC PN"));
+        }
+
+        auto [it, inserted] = groupIndices.try_emplace(key, groups.size());
+        if (inserted) {
+            groups.push_back({strings[key.type], strings[key.value], key.voltage, strings[key.footprint],
+                strings[key.manufacturer], strings[key.mpn], strings[key.lcscPn], {}, {}});
+        }
+        groups[it->second].parts.push_back(i);
+    }
+
+    // sort once for deterministic output
+    std::ranges::sort(groups, {}, [](const BomGroup &group) {
+        return std::tie(group.type, group.value, group.voltage, group.footprint, group.manufacturer, group.mpn,
+            group.lcscPn);
+    });
+
+    // designators in natural order
+    for (auto &group : groups) {
+        group.designators.reserve(group.parts.size());
+        for (auto part : group.parts)
+            group.designators.push_back(getDesignatorKey(footprints.references[part]));
+        std::ranges::sort(group.designators);
+    }
+    return groups;
+}
+
+} // namespace kicad
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "kicad.hpp"
+#include <compare>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace kicad {
+
+/// @brief Get the type of a component from its reference
+/// @param reference Reference, e.g. "R1"
+/// @return Type, e.g. "R"
+std::string_view getType(std::string_view reference);
+
+/// @brief Key for sorting designators in natural order, e.g. R2 before R10
+///
+struct DesignatorKey {
+    // prefix, e.g. "R" (see getType())
+    std::string_view prefix;
+
+    // number after the prefix, e.g. 10
+    uint64_t number;
+
+    // complete designator, orders designators with same prefix and number, e.g. "R10" and "R10A"
+    std::string_view designator;
+
+    auto operator <=>(const DesignatorKey &other) const noexcept = default;
+};
+
+/// @brief Parse a designator into a key for natural sorting
+/// @param designator Designator (reference), e.g. "R10"
+/// @return Sort key
+DesignatorKey getDesignatorKey(std::string_view designator);
+
+/// @brief Join sorted designators and compress runs of three or more consecutive numbers into ranges
+/// @param designators Designators in natural order
+/// @return Comma separated list, e.g. "C1,C2,R1-R8,R10"
+std::string compressDesignators(std::span<const DesignatorKey> designators);
+
+
+/// @brief Footprints of a board in structure-of-arrays layout. Gets extracted in one pass over the board and is then
+/// shared by all output generators (BOM, CPL, drill). Strings reference the memory of the kicad::Document the table
+/// was built from
+class FootprintTable {
+public:
+    /// @brief Footprint attributes (attr container), can be combined
+    enum Attribute : uint8_t {
+        SMD = 1,
+        THROUGH_HOLE = 2,
+        BOARD_ONLY = 4,
+        EXCLUDE_FROM_POS_FILES = 8,
+        EXCLUDE_FROM_BOM = 16,
+        DNP = 32,
+    };
+
+    /// @brief Extract all footprints of a board. Footprints whose text is unchanged since a previous build get copied
+    /// from the previous table instead of being parsed, which makes rebuilding after an edit of a large board cheap.
+    /// Only footprints that were not parsed yet (see ReadOptions::lazy) can be reused, footprints of a table built from
+    /// a snapshot get hashed but are not reused
+    /// @param board Root container of a .kicad_pcb file
+    /// @param previous Table built from a previous version of the board or nullptr, its document must still exist
+    /// @return Number of footprints that were copied from the previous table
+    size_t build(Container &board, const FootprintTable *previous = nullptr);
+
+    /// @brief Get a hash of the text of all footprints, changes if any footprint changes
+    /// @return Hash or 0 if a footprint was already parsed when the table was built
+    uint64_t getHash() const;
+
+    /// @brief Number of footprints
+    size_t size() const {return this->references.size();}
+
+    /// @brief Check if a footprint has an attribute
+    /// @param index Index of the footprint
+    /// @param attribute Attribute, e.g. DNP
+    bool has(size_t index, Attribute attribute) const {return (this->attributes[index] & attribute) != 0;}
+
+    /// @brief Find a property of a footprint
+    /// @param index Index of the footprint
+    /// @param name Name of the property, e.g. "LCSC PN"
+    /// @return Index into propertyNames and propertyValues or -1 if not found
+    int findProperty(size_t index, std::string_view name) const;
+
+    /// @brief Get a property of a footprint
+    /// @param index Index of the footprint
+    /// @param name Name of the property, e.g. "LCSC PN"
+    /// @return Value of the property or empty if not found
+    std::string_view getProperty(size_t index, std::string_view name) const {
+        int property = findProperty(index, name);
+        return property >= 0 ? this->propertyValues[property] : std::string_view();
+    }
+
+// footprint columns, one row per footprint
+
+    // footprint name including library, e.g. "Resistor_SMD:R_0603_1608Metric"
+    std::vector<std::string_view> footprints;
+
+    // footprint name without library, e.g. "R_0603_1608Metric"
+    std::vector<std::string_view> names;
+
+    // reference, e.g. "R1"
+    std::vector<std::string_view> references;
+
+    // value, e.g. "100k"
+    std::vector<std::string_view> values;
+
+    // type derived from the reference, e.g. "R"
+    std::vector<std::string_view> types;
+
+    // layer, e.g. "F.Cu"
+    std::vector<std::string_view> layers;
+
+    // position and rotation in degrees
+    std::vector<double> positionX;
+    std::vector<double> positionY;
+    std::vector<double> rotations;
+
+    // combination of Attribute flags
+    std::vector<uint8_t> attributes;
+
+    // text of the footprint if it was not parsed yet, empty otherwise
+    std::vector<std::string_view> texts;
+
+    // hash of the text if the footprint was not parsed yet or was read from a snapshot, 0 otherwise
+    std::vector<uint64_t> textHashes;
+
+    // pads of footprint i are padBegin[i] to padBegin[i + 1] - 1
+    std::vector<uint32_t> padBegin = {0};
+
+    // properties of footprint i are propertyBegin[i] to propertyBegin[i + 1] - 1
+    std::vector<uint32_t> propertyBegin = {0};
+
+// pad columns
+
+    // pad name, e.g. "1", empty for holes
+    std::vector<std::string_view> padNames;
+
+    // pad type, e.g. "smd" or "thru_hole"
+    std::vector<std::string_view> padTypes;
+
+    // position relative to the footprint
+    std::vector<double> padX;
+    std::vector<double> padY;
+
+    // rotation in degrees including the rotation of the footprint
+    std::vector<double> padRotations;
+
+    // drill size, width and height differ for oval holes, zero if the pad has no hole
+    std::vector<double> drillWidths;
+    std::vector<double> drillHeights;
+
+// property columns
+
+    // property name, e.g. "Reference"
+    std::vector<std::string_view> propertyNames;
+
+    // property value, e.g. "R1"
+    std::vector<std::string_view> propertyValues;
+
+protected:
+    // copy a footprint of another table whose text is identical to the given text
+    void copy(const FootprintTable &other, size_t index, std::string_view text);
+};
+
+
+/// @brief Fields that the parts of a BOM are grouped by
+enum class BomFormat : uint8_t {
+    // type, value, voltage, footprint name, manufacturer and MPN, leaves out parts excluded from the BOM
+    GENERIC,
+
+    // type, value, footprint name and LCSC PN, leaves out parts excluded from the BOM and DNP parts
+    JLCPCB,
+};
+
+/// @brief Parts of a BOM with equal fields. Fields that the format does not group by are empty or 0, strings
+/// reference the memory of the kicad::Document of the footprint table
+struct BomGroup {
+    // type, e.g. "R"
+    std::string_view type;
+
+    // value, e.g. "100k"
+    std::string_view value;
+
+    // voltage in mV
+    int voltage;
+
+    // footprint name without library, e.g. "R_0603_1608Metric"
+    std::string_view footprint;
+
+    // manufacturer and manufacturer part number
+    std::string_view manufacturer;
+    std::string_view mpn;
+
+    // part number of JLCPCB
+    std::string_view lcscPn;
+
+    // indices of the parts in the footprint table in board order
+    std::vector<uint32_t> parts;
+
+    // designators of the parts in natural order
+    std::vector<DesignatorKey> designators;
+};
+
+/// @brief Group the parts of a BOM. Strings are interned and the groups are collected in a hash table, then sorted by
+/// their fields once for deterministic output
+/// @param footprints Footprints of the board
+/// @param format Format that determines the fields to group by
+/// @param invalidVoltages Receives the indices of the parts whose voltage property is not a number (GENERIC only), the
+/// voltage of these parts is 0
+/// @return Groups sorted by type, value, voltage, footprint name, manufacturer, MPN and LCSC PN
+std::vector<BomGroup> groupBom(const FootprintTable &footprints, BomFormat format,
+    std::vector<uint32_t> *invalidVoltages = nullptr);
+
+} // namespace kicad
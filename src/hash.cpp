@@ -0,0 +1,113 @@
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include <bit>
+#include <cstring>
+
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t read64(const char *p) {
+    uint64_t value;
+    std::memcpy(&value, p, 8);
+    return value;
+}
+
+inline uint32_t read32(const char *p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = std::rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t merge(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+} // anonymous namespace
+
+
+uint64_t hash64(std::string_view data, uint64_t seed) {
+    const char *p = data.data();
+    const char *end = p + data.size();
+    uint64_t h;
+
+    if (data.size() >= 32) {
+        // process 32 byte stripes with four accumulators
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const char *limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += data.size();
+
+    // remaining bytes
+    while (p + 8 <= end) {
+        h ^= round(0, read64(p));
+        h = std::rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * PRIME1;
+        h = std::rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= uint64_t(uint8_t(*p)) * PRIME5;
+        h = std::rotl(h, 11) * PRIME1;
+        ++p;
+    }
+
+    // avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool hashFile(const std::filesystem::path &path, uint64_t &hash) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    hash = hash64(file.data());
+    return true;
+}
+
+std::string toHex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string str(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        str[i] = digits[hash & 15];
+        hash >>= 4;
+    }
+    return str;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+
+/// @brief Calculate a 64 bit hash of data (XXH64). Not cryptographic, but fast and good enough to detect changes
+/// @param data Data to hash
+/// @param seed Seed, e.g. the hash of preceding data
+/// @return Hash value
+uint64_t hash64(std::string_view data, uint64_t seed = 0);
+
+/// @brief Calculate the hash of a file
+/// @param path Path of the file
+/// @param hash Receives the hash value
+/// @return true if the file could be read
+bool hashFile(const std::filesystem::path &path, uint64_t &hash);
+
+/// @brief Convert a hash to a hex string with 16 digits
+std::string toHex(uint64_t hash);
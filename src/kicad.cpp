@@ -1,150 +1,543 @@
 #include "kicad.hpp"
+#include "hash.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <new>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <thread>
 
 
 namespace kicad {
 
 namespace {
 
-// tokens
-enum class Token {
-    CONTAINER,
-    CONTAINER_END,
-    VALUE,
-    FILE_END,
+// keywords in the same order as enum class Atom
+constexpr std::string_view keywords[] = {
+    "",
+    "angle",
+    "arc",
+    "at",
+    "attr",
+    "center",
+    "chamfer",
+    "chamfer_ratio",
+    "clearance",
+    "connect",
+    "descr",
+    "drill",
+    "effects",
+    "embedded_fonts",
+    "end",
+    "fill",
+    "filled_areas_thickness",
+    "filled_polygon",
+    "font",
+    "footprint",
+    "fp_arc",
+    "fp_circle",
+    "fp_curve",
+    "fp_line",
+    "fp_poly",
+    "fp_rect",
+    "fp_text",
+    "general",
+    "generator",
+    "generator_version",
+    "gr_arc",
+    "gr_circle",
+    "gr_curve",
+    "gr_line",
+    "gr_poly",
+    "gr_rect",
+    "gr_text",
+    "group",
+    "hatch",
+    "hide",
+    "island",
+    "justify",
+    "kicad_pcb",
+    "layer",
+    "layers",
+    "layerselection",
+    "mid",
+    "min_thickness",
+    "model",
+    "net",
+    "net_name",
+    "offset",
+    "outputdirectory",
+    "pad",
+    "pad_to_mask_clearance",
+    "paper",
+    "path",
+    "pcbplotparams",
+    "plot_on_all_layers_selection",
+    "polygon",
+    "primitives",
+    "priority",
+    "property",
+    "pts",
+    "rect_delta",
+    "rev",
+    "rotate",
+    "roundrect_rratio",
+    "scale",
+    "segment",
+    "setup",
+    "sheetfile",
+    "sheetname",
+    "size",
+    "solder_mask_margin",
+    "solder_paste_margin",
+    "stackup",
+    "start",
+    "stroke",
+    "tags",
+    "teardrop",
+    "thermal_bridge_width",
+    "thermal_gap",
+    "thickness",
+    "title",
+    "title_block",
+    "tstamp",
+    "type",
+    "unlocked",
+    "uuid",
+    "version",
+    "via",
+    "width",
+    "xy",
+    "xyz",
+    "zone",
+    "zone_connect",
 };
+static_assert(std::size(keywords) == size_t(Atom::ZONE_CONNECT) + 1);
+static_assert(std::ranges::is_sorted(keywords));
 
+// create an object in a memory resource, gets destroyed when the resource is released
+template <typename T, typename ...Args>
+T *create(std::pmr::memory_resource *resource, Args &&...args) {
+    return new (resource->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
 
-class Tokenizer {
-public:
-    Tokenizer(std::istream &s) : s(s) {}
+std::string_view copy(std::pmr::memory_resource *resource, std::string_view str) {
+    if (str.empty())
+        return {};
+    auto data = static_cast<char *>(resource->allocate(str.size(), 1));
+    memcpy(data, str.data(), str.size());
+    return {data, str.size()};
+}
+
+using Strings = std::unordered_map<std::string_view, Atom>;
+
+// store a container id in a memory resource and look up its atom
+std::pair<std::string_view, Atom> intern(Strings &strings, std::pmr::memory_resource *resource, std::string_view id) {
+    auto it = strings.find(id);
+    if (it != strings.end())
+        return *it;
+    auto atom = toAtom(id);
+    id = copy(resource, id);
+    strings.emplace(id, atom);
+    return {id, atom};
+}
+
+// release all elements of a document but keep the source
+void clearElements(Document &document) {
+    // elements and strings are in the arenas
+    document.root.id = {};
+    document.root.atom = Atom::NONE;
+    document.root.clear();
+    document.root.elements = Container::Elements(&document.arena);
+    document.strings.clear();
+    document.arenas.clear();
+    document.arena.release();
+}
 
-    Token getToken() {
-        if (!refill())
-            return Token::FILE_END;
-        char ch = this->buffer[this->pos];
-        if (ch == '(')
-            return Token::CONTAINER;
-        if (ch == ')')
-            return Token::CONTAINER_END;
-        return Token::VALUE;
+class Reader {
+public:
+    enum class Result {
+        // all elements are complete
+        OK,
+
+        // all elements are complete and the end of the enclosing container was reached
+        CLOSED,
+
+        // an element is incomplete
+        INCOMPLETE,
+    };
+
+    /// @brief Constructor
+    /// @param t Tokenizer
+    /// @param resource Memory resource for elements and strings
+    /// @param strings Interned container ids, nullptr to reference the ids in the token text
+    /// @param persistent Token text stays valid while the document exists and does not need to be copied
+    /// @param lazy Skip the elements of top level containers (persistent only)
+    /// @param depth Depth of the elements to read, 0 for a file, 1 for the elements of the root container
+    Reader(Tokenizer &t, std::pmr::memory_resource *resource, Strings *strings, bool persistent, bool lazy = false,
+        int depth = 0)
+        : t(t), resource(resource), strings(strings), persistent(persistent), lazy(lazy), depth(depth) {}
+
+    void readFile(Container &root) {
+        // file starts with a container
+        auto token = t.getToken();
+        if (token == Token::CONTAINER)
+            readContainer(root);
     }
 
-    double readNumber() {
-        std::string str;
-        readString(str);
-        return std::stod(str);
+    /// @brief Read a container after its '('
+    /// @param container Container to read into
+    /// @return true if the container is complete
+    bool readContainer(Container &container) {
+        auto id = t.readContainer();
+        if (this->strings != nullptr) {
+            auto [i, atom] = intern(*this->strings, this->resource, id);
+            container.id = i;
+            container.atom = atom;
+        } else {
+            container.id = id;
+            container.atom = toAtom(id);
+        }
+
+        // only record the text of top level containers in lazy mode
+        if (this->lazy && this->depth == 1) {
+            container.elements.push_back(create<Value>(this->resource, t.skipContainer()));
+            container.deferred = Container::Deferred::TEXT;
+            return !t.isTruncated();
+        }
+
+        // collect elements on a stack and copy them into an array of exact size when the container is complete
+        size_t mark = this->stack.size();
+        ++this->depth;
+        auto result = readElements();
+        --this->depth;
+        container.elements.assign(this->stack.begin() + mark, this->stack.end());
+        this->stack.resize(mark);
+        return result == Result::CLOSED;
     }
 
-    void readContainer(std::string &str) {
-        // skip '('
-        ++this->pos;
-        readString(str);
+    /// @brief Read a sequence of elements, e.g. a chunk of the top level elements of a file
+    /// @param elements Elements that were read
+    /// @return Result
+    Result readElements(std::vector<Element *> &elements) {
+        auto result = readElements();
+        if (t.isTruncated())
+            result = Result::INCOMPLETE;
+        elements.assign(this->stack.begin(), this->stack.end());
+        this->stack.clear();
+        return result;
     }
 
-    void readContainerEnd() {
-        // skip ')'
-        ++this->pos;
+protected:
+    Result readElements() {
+        while (true) {
+            auto token = t.getToken();
+            switch (token) {
+            case Token::CONTAINER:
+                {
+                    auto c = create<Container>(this->resource, std::string_view(), Atom::NONE, this->resource);
+                    this->stack.push_back(c);
+                    if (!readContainer(*c))
+                        return Result::INCOMPLETE;
+                }
+                break;
+            case Token::VALUE:
+                {
+                    auto str = t.readString();
+                    if (!this->persistent)
+                        str = copy(this->resource, str);
+                    this->stack.push_back(create<Value>(this->resource, str));
+                }
+                break;
+            case Token::CONTAINER_END:
+                t.readContainerEnd();
+                return Result::CLOSED;
+            case Token::FILE_END:
+                return Result::OK;
+            }
+        }
     }
 
-    bool readString(std::string &str) {
-        const char *b = this->buffer;
-        int p = this->pos;
-        int e = this->end;
+    Tokenizer &t;
+    std::pmr::memory_resource *resource;
+    Strings *strings;
+    bool persistent;
+    bool lazy;
+    int depth;
+    std::vector<Element *> stack;
+};
+
+// scans a file and reports its elements to a visitor
+class Walker {
+public:
+    Walker(Tokenizer &t, Visitor &visitor, const std::vector<Path> &paths)
+        : t(t), visitor(visitor), paths(paths) {}
 
-        char ch = b[p];
-        if (ch == '"') {
-            // quoted string
-            do {
-                ++p;
-                if (p >= e)
+    void visitFile() {
+        // file starts with a container
+        auto token = t.getToken();
+        if (token == Token::CONTAINER)
+            visitContainer(0);
+    }
+
+protected:
+    // visit a container after its '('
+    void visitContainer(int depth) {
+        auto id = t.readContainer();
+        auto atom = toAtom(id);
+        if (depth > 0)
+            this->path.push_back(atom);
+
+        if (matches() && this->visitor.beginContainer(id, atom, depth)) {
+            bool end = false;
+            while (!end) {
+                auto token = t.getToken();
+                switch (token) {
+                case Token::CONTAINER:
+                    visitContainer(depth + 1);
+                    break;
+                case Token::VALUE:
+                    this->visitor.value(t.readString(), depth);
+                    break;
+                case Token::CONTAINER_END:
+                    t.readContainerEnd();
+                    // fall through
+                case Token::FILE_END:
+                    end = true;
                     break;
-                if (b[p] == '\\') {
-                    p += 2;
-                    if (p >= e)
-                        break;
                 }
-            } while (b[p] != '"');
-            str.assign(b + this->pos/* + 1*/, p + 1 - (this->pos/* + 1*/));
-            this->pos = p + 1;
-            return true;
+            }
+            this->visitor.endContainer(depth);
         } else {
-            // identifier
-            do {
-                ++p;
-                if (p >= e)
-                    break;
-            } while (b[p] != ')' && uint8_t(b[p]) > ' ');
-            str.assign(b + this->pos, p - this->pos);
-            this->pos = p;
-            return false;
+            t.skipContainer();
         }
+
+        if (depth > 0)
+            this->path.pop_back();
     }
 
-protected:
-    bool refill() {
-        char *b = this->buffer;
-        int p = this->pos;
-        int e = this->end;
-        while (p < e && uint8_t(p[b]) <= ' ') {
-            ++p;
+    // check if the current path is on or below one of the paths
+    bool matches() {
+        if (this->paths.empty())
+            return true;
+        for (auto &p : this->paths) {
+            size_t n = std::min(this->path.size(), p.size());
+            if (std::equal(this->path.begin(), this->path.begin() + n, p.begin()))
+                return true;
         }
+        return false;
+    }
 
-        int size = e - p;
-        if (size < 1024) {
-            memmove(b, b + p, size);
+    Tokenizer &t;
+    Visitor &visitor;
+    const std::vector<Path> &paths;
+    Path path;
+};
 
-            // read
-            s.read(b + size, 2048 - size);
-            p = 0;
-            e = size + s.gcount();
+// read the top level elements of a file in parallel, return false if the file could not be split into chunks
+bool readParallel(std::string_view data, Document &document, int threadCount, bool lazy) {
+    // read id of root container
+    Tokenizer t(data);
+    if (t.getToken() != Token::CONTAINER)
+        return false;
+    auto [id, atom] = intern(document.strings, document.resource(), t.readContainer());
+    size_t start = t.position();
+
+    // get indentation of the first top level element, e.g. "\n\t("
+    size_t begin = data.find('\n', start);
+    if (begin == std::string_view::npos)
+        return false;
+    size_t end = begin + 1;
+    while (end < data.size() && (data[end] == ' ' || data[end] == '\t'))
+        ++end;
+    if (end >= data.size() || data[end] != '(')
+        return false;
+    auto pattern = data.substr(begin, end + 1 - begin);
+
+    // split into chunks at top level elements
+    int chunkCount = threadCount * 4;
+    size_t chunkSize = (data.size() - start) / chunkCount;
+    std::vector<size_t> bounds = {start};
+    for (int i = 1; i < chunkCount; ++i) {
+        size_t pos = data.find(pattern, std::max(start + i * chunkSize, bounds.back()));
+        if (pos == std::string_view::npos)
+            break;
+
+        // chunk starts at '('
+        bounds.push_back(pos + pattern.size() - 1);
+    }
+    bounds.push_back(data.size());
+    chunkCount = bounds.size() - 1;
+
+    // parse chunks using one arena per chunk
+    struct Chunk {
+        std::vector<Element *> elements;
+        Reader::Result result;
+    };
+    std::vector<Chunk> chunks(chunkCount);
+    for (int i = 0; i < chunkCount; ++i)
+        document.arenas.emplace_back(&document.memory);
+    std::atomic<int> next = 0;
+    auto worker = [&] {
+        while (true) {
+            int i = next++;
+            if (i >= chunkCount)
+                break;
+            Tokenizer t(data.substr(bounds[i], bounds[i + 1] - bounds[i]));
+            Strings strings;
+            Reader r(t, &document.arenas[i], &strings, true, lazy, 1);
+            chunks[i].result = r.readElements(chunks[i].elements);
         }
-        this->pos = p;
-        this->end = e;
-        return p < e;
+    };
+    {
+        std::vector<std::jthread> threads;
+        for (int i = 1; i < std::min(threadCount, chunkCount); ++i)
+            threads.emplace_back(worker);
+        worker();
     }
 
-    std::istream &s;
-    char buffer[2048];
-    int pos = 0;
-    int end = 0;
-};
+    // check if all chunks consist of complete elements, only the last chunk contains the end of the root container
+    for (int i = 0; i < chunkCount; ++i) {
+        auto result = chunks[i].result;
+        if (result == Reader::Result::INCOMPLETE || (result == Reader::Result::CLOSED) != (i == chunkCount - 1))
+            return false;
+    }
 
-Value *readValue(Tokenizer &t) {
-    auto str = new Value();
-    /*str->quote = */t.readString(str->value);
-    return str;
+    // stitch elements into root container in file order
+    auto &root = document.root;
+    root.id = id;
+    root.atom = atom;
+    size_t count = 0;
+    for (auto &chunk : chunks)
+        count += chunk.elements.size();
+    root.elements.reserve(count);
+    for (auto &chunk : chunks)
+        root.elements.insert(root.elements.end(), chunk.elements.begin(), chunk.elements.end());
+    return true;
 }
 
-void readContainer(Tokenizer &t, Container &container) {
-    t.readContainer(container.id);
+// read a file that is kept in memory by the document
+void readText(Document &document, const ReadOptions &options) {
+    int threadCount = options.threadCount;
+    if (threadCount <= 0)
+        threadCount = std::max(int(std::thread::hardware_concurrency()), 1);
 
-    while (true) {
-        auto token = t.getToken();
-        switch (token) {
-        case Token::CONTAINER:
-            {
-                Container *c = new Container();
-                readContainer(t, *c);
-                container.elements.push_back(c);
-            }
-            break;
-        case Token::CONTAINER_END:
-            t.readContainerEnd();
-            return;
-        case Token::VALUE:
-            container.elements.push_back(readValue(t));
-            break;
-        case Token::FILE_END:
+    // parse in parallel if the file is large enough
+    if (threadCount > 1 && document.text.size() >= 1024 * 1024) {
+        if (readParallel(document.text, document, threadCount, options.lazy))
             return;
-        }
+        clearElements(document);
     }
+
+    Tokenizer t(document.text);
+    Reader r(t, document.resource(), &document.strings, true, options.lazy);
+    r.readFile(document.root);
 }
 
+// containers with fewer elements are searched linearly
+constexpr size_t INDEX_MIN_SIZE = 32;
+
+// writes a container into a buffer that gets flushed to the output stream in large blocks
+class Writer {
+public:
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+    Writer(std::ostream &s) : s(s) {
+        this->buffer.reserve(BUFFER_SIZE + 1024);
+    }
+
+    ~Writer() {
+        flush();
+    }
+
+    void writeFile(Container &container, int indent) {
+        // get the sizes of all containers in one pass, they decide which containers are written on multiple lines
+        measure(container);
+        this->next = 0;
+        write(container, indent);
+    }
+
+protected:
+    // count elements of a container including itself, store the count of each container in pre-order
+    int measure(Container &container) {
+        container.expand();
+        size_t index = this->counts.size();
+        this->counts.push_back(0);
+        int c = 1;
+        for (auto element : container.elements) {
+            auto child = element->asContainer();
+            c += child != nullptr ? measure(*child) : 1;
+        }
+        this->counts[index] = c;
+        return c;
+    }
+
+    void write(Container &container, int indent) {
+        bool multiLine = this->counts[this->next++] > 16;
+
+        this->buffer += '(';
+        this->buffer += container.id;
+
+        bool multiline2 = false;
+        for (auto element : container.elements) {
+            auto child = element->asContainer();
+            multiline2 |= child != nullptr;
+
+            if (multiLine && multiline2) {
+                newLine(indent + 1);
+            } else {
+                this->buffer += ' ';
+            }
+
+            if (child != nullptr)
+                write(*child, indent + 1);
+            else
+                this->buffer += element->asValue()->value;
+        }
+        if (multiLine && multiline2) {
+            newLine(indent);
+        }
+        this->buffer += ')';
+
+        if (this->buffer.size() >= BUFFER_SIZE)
+            flush();
+    }
+
+    void newLine(int indent) {
+        this->buffer += '\n';
+        this->buffer.append(indent * 2, ' ');
+    }
+
+    void flush() {
+        this->s.write(this->buffer.data(), this->buffer.size());
+        this->buffer.clear();
+    }
+
+    std::ostream &s;
+    std::string buffer;
+    std::vector<int> counts;
+    size_t next = 0;
+};
+
 } // namespace
 
 
+Atom toAtom(std::string_view keyword) {
+    auto it = std::ranges::lower_bound(keywords, keyword);
+    if (it != std::end(keywords) && *it == keyword)
+        return Atom(it - keywords);
+    return Atom::NONE;
+}
+
+std::string_view toString(Atom atom) {
+    return keywords[int(atom)];
+}
+
+
 /*std::string toString(std::string_view value) {
     std::string str;
     str += '"';
@@ -155,22 +548,27 @@ void readContainer(Tokenizer &t, Container &container) {
 
 // Element
 
-Element::~Element() {
+int Element::count() {
+    if (isContainer())
+        return static_cast<Container *>(this)->count();
+    return static_cast<Value *>(this)->count();
 }
 
-Element::Action Element::sweep(){
+Element::Action Element::sweep() {
+    if (isContainer())
+        return static_cast<Container *>(this)->sweep();
     return this->action;
 }
 
-
-// Value
-
-Value::~Value() {
+void Element::write(std::ostream &s, int indent) {
+    if (isContainer())
+        static_cast<Container *>(this)->write(s, indent);
+    else
+        static_cast<Value *>(this)->write(s, indent);
 }
 
-int Value::count() {
-    return 1;
-}
+
+// Value
 
 void Value::write(std::ostream &s, int indent) {
     s << this->value;
@@ -180,26 +578,22 @@ std::string Value::getString(std::string_view defaultValue) {
     // remove quotes
     int size = this->value.size();
     if (size >= 2 && this->value.front() == '"' && this->value.back() == '"')
-        return this->value.substr(1, size - 2);
+        return std::string(this->value.substr(1, size - 2));
 
-    return this->value;
+    return std::string(this->value);
 }
 
-void Value::setString(std::string_view value) {
-    this->value = '"';
-    this->value += value;
-    this->value += '"';
+void Value::parseNumber() {
+    this->parsed = kicad::parseNumber(this->value, this->number) ? Parsed::NUMBER : Parsed::NOT_A_NUMBER;
 }
 
 
 
-// Container
 
-Container::~Container() {
-    clear();
-}
+// Container
 
 int Container::count() {
+    expand();
     int c = 1;
     for (auto element : this->elements) {
         c += element->count();
@@ -208,12 +602,13 @@ int Container::count() {
 }
 
 Element::Action Container::sweep() {
+    expand();
     auto dst = this->elements.begin();
     bool keep = false;
     for (auto src = dst; src != this->elements.end(); ++src) {
         auto action = (*src)->sweep();
         if (action != Action::KEEP && (*src)->action == Action::DELETE) {
-            delete *src;
+            // memory of the element gets released together with the document
         } else {
             *dst = *src;
             ++dst;
@@ -221,66 +616,69 @@ Element::Action Container::sweep() {
         }
     }
     this->elements.erase(dst, this->elements.end());
+    invalidateIndex();
     return keep ? Action::KEEP : this->action;
 }
 
 void Container::write(std::ostream &s, int indent) {
-    bool multiLine = count() > 16;
-
-    s << '(' << this->id;
-
-    bool multiline2 = false;
-    for (auto element : this->elements) {
-        multiline2 |= dynamic_cast<Container *>(element) != nullptr;
-
-        if (multiLine && multiline2) {
-            newLine(s, indent + 1);
-        } else {
-            s << ' ';
-        }
-
-        element->write(s, indent + 1);
-    }
-    if (multiLine && multiline2) {
-        newLine(s, indent);
-    }
-    s << ')';
+    Writer w(s);
+    w.writeFile(*this, indent);
 }
 
 Container &Container::clear() {
-    for (auto element : this->elements) {
-        delete element;
-    }
     this->elements.clear();
+    this->deferred = Deferred::NO;
+    this->index = nullptr;
     return *this;
 }
 
+void Container::add(Element *element) {
+    expand();
+    this->elements.push_back(element);
+
+    // keep the index up to date
+    auto container = element->asContainer();
+    if (container != nullptr && this->index != nullptr && this->index->valid)
+        insertIndex(container);
+}
+
 Container *Container::add(std::string_view id) {
-    auto container = new Container(id);
-    this->elements.push_back(container);
+    auto container = create<Container>(resource(), copy(id), resource());
+    add(container);
+    return container;
+}
+
+Container *Container::add(Atom atom) {
+    auto container = create<Container>(resource(), toString(atom), atom, resource());
+    add(container);
     return container;
 }
 
 Container &Container::addValue(std::string_view value) {
-    this->elements.push_back(new Value(value));
+    expand();
+    this->elements.push_back(create<Value>(resource(), copy(value)));
     return *this;
 }
 
 Container &Container::setTag(int index, std::string_view value) {
+    expand();
     if (index >= this->elements.size())
         this->elements.resize(index + 1);
-    this->elements[index] = new Value(value);
+    this->elements[index] = create<Value>(resource(), copy(value));
+    invalidateIndex();
     return *this;
 }
 
 Container &Container::setString(int index, std::string_view value) {
+    expand();
     if (index >= this->elements.size())
         this->elements.resize(index + 1);
-    auto v = new Value();
-    v->value = '"';
-    v->value += value;
-    v->value += '"';
-    this->elements[index] = v;
+    std::string str;
+    str += '"';
+    str += value;
+    str += '"';
+    this->elements[index] = create<Value>(resource(), copy(str));
+    invalidateIndex();
     return *this;
 }
 
@@ -292,11 +690,13 @@ Container &Container::setString(int index, std::string_view value) {
 }*/
 
 Container &Container::setNumber(int index, double value) {
+    expand();
     if (index >= this->elements.size())
         this->elements.resize(index + 1);
     std::stringstream ss;
     ss << value;
-    this->elements[index] = new Value(ss.str());
+    this->elements[index] = create<Value>(resource(), copy(ss.str()));
+    invalidateIndex();
     return *this;
 }
 
@@ -305,7 +705,7 @@ std::string Container::getTag(int index, std::string_view defaultValue) {
     if (value == nullptr)
         return std::string(defaultValue);
 
-    return value->value;
+    return std::string(value->value);
 }
 
 std::string Container::getString(int index, std::string_view defaultValue) {
@@ -322,35 +722,29 @@ std::string Container::getString(int index, std::string_view defaultValue) {
 }
 
 int Container::getInt(int index, int defaultValue) {
-    auto value = getValue(index);
-    if (value == nullptr)
-        return defaultValue;
-
-    // cast to int
-    try {
-        return std::stoi(value->getString());
-    } catch (std::exception &) {
-        return defaultValue;
-    }
+    int number;
+    if (tryGetInt(index, number))
+        return number;
+    return defaultValue;
 }
 
 double Container::getNumber(int index, double defaultValue) {
-    auto value = getValue(index);
-    if (value == nullptr)
-        return defaultValue;
+    double number;
+    if (tryGetNumber(index, number))
+        return number;
+    return defaultValue;
+}
 
-    // cast to double
-    try {
-        return std::stod(value->getString());
-    } catch (std::exception &) {
-        return defaultValue;
-    }
+bool Container::tryGetInt(int index, int &number) {
+    auto value = getValue(index);
+    return value != nullptr && parseNumber(value->value, number);
 }
 
 
 bool Container::contains(std::string_view tag) {
+    expand();
     for (auto element : this->elements) {
-        auto v = dynamic_cast<Value *>(element);
+        auto v = element->asValue();
         if (v != nullptr) {
             if (v->value == tag)
                 return true;
@@ -360,8 +754,16 @@ bool Container::contains(std::string_view tag) {
 }
 
 Container *Container::find(std::string_view id) {
+    // compare atoms if the id is a known keyword
+    auto atom = toAtom(id);
+    if (atom != Atom::NONE)
+        return find(atom);
+
+    expand();
+    if (this->elements.size() >= INDEX_MIN_SIZE)
+        return findIndexed(id);
     for (auto element : this->elements) {
-        auto container = dynamic_cast<Container *>(element);
+        auto container = element->asContainer();
         if (container != nullptr) {
             if (container->id == id) {
                 return container;
@@ -371,87 +773,357 @@ Container *Container::find(std::string_view id) {
     return nullptr;
 }
 
-Container *Container::findOrAdd(std::string_view id) {
+Container *Container::find(Atom atom) {
+    expand();
+    if (this->elements.size() >= INDEX_MIN_SIZE) {
+        // the id of a container with a known atom is the keyword
+        return findIndexed(toString(atom));
+    }
     for (auto element : this->elements) {
-        auto container = dynamic_cast<Container *>(element);
+        auto container = element->asContainer();
         if (container != nullptr) {
-            if (container->id == id) {
+            if (container->atom == atom) {
                 return container;
             }
         }
     }
-    auto container = new Container(id);
-    this->elements.push_back(container);
-    return container;
+    return nullptr;
 }
 
-std::string Container::findString(std::string_view id) {
+Container *Container::findOrAdd(std::string_view id) {
     auto container = find(id);
+    if (container != nullptr)
+        return container;
+    return add(id);
+}
+
+Container *Container::findOrAdd(Atom atom) {
+    auto container = find(atom);
+    if (container != nullptr)
+        return container;
+    return add(atom);
+}
+
+std::string Container::stringOf(Container *container) {
     if (container != nullptr)
         return container->getString(0);
     return {};
 }
 
-double Container::findNumber(std::string_view id) {
-    auto container = find(id);
+double Container::numberOf(Container *container) {
     if (container != nullptr)
         return container->getNumber(0);
     return {};
 }
 
-Container::Value2<std::string> Container::findString2(std::string_view id) {
-    auto container = find(id);
+Container::Value2<std::string> Container::string2Of(Container *container) {
     if (container != nullptr)
         return {container->getString(0), container->getString(1)};
     return {};
 }
 
-Container::Value2<double> Container::findNumber2(std::string_view id) {
-    auto container = find(id);
+Container::Value2<double> Container::number2Of(Container *container) {
     if (container != nullptr)
         return {container->getNumber(0), container->getNumber(1)};
     return {};
 }
 
 void Container::erase(Element *element) {
+    expand();
     for (auto it = this->elements.begin(); it != this->elements.end(); ++it) {
         if (*it == element) {
             this->elements.erase(it);
-            delete element;
+            invalidateIndex();
             return;
         }
     }
 }
 
 void Container::erase(std::string_view id) {
+    // compare atoms if the id is a known keyword
+    auto atom = toAtom(id);
+    if (atom != Atom::NONE) {
+        erase(atom);
+        return;
+    }
+
+    expand();
     auto it = this->elements.begin();
     while (it != this->elements.end()) {
-        auto container = dynamic_cast<kicad::Container *>(*it);
-        if (container->id == id) {
+        auto container = (*it)->asContainer();
+        if (container != nullptr && container->id == id) {
             it = this->elements.erase(it);
-            delete container;
         } else {
             ++it;
         }
     }
+    invalidateIndex();
+}
+
+void Container::erase(Atom atom) {
+    expand();
+    auto it = this->elements.begin();
+    while (it != this->elements.end()) {
+        auto container = (*it)->asContainer();
+        if (container != nullptr && container->atom == atom) {
+            it = this->elements.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    invalidateIndex();
+}
+
+void Container::setId(std::string_view id) {
+    this->id = copy(id);
+    this->atom = toAtom(id);
+}
+
+uint64_t Container::getDeferredHash() {
+    if (this->deferred == Deferred::TEXT)
+        return hash64(getDeferredText());
+    if (this->deferred == Deferred::CUSTOM)
+        return static_cast<DeferredElements *>(this->elements.front())->getHash();
+    return 0;
+}
+
+void Container::expandDeferred() {
+    std::vector<Element *> elements;
+    if (this->deferred == Deferred::TEXT) {
+        // the text references the document and does not need to be copied
+        auto text = this->elements.front()->asValue()->value;
+        Tokenizer t(text);
+        Reader r(t, resource(), nullptr, true);
+        r.readElements(elements);
+    } else {
+        static_cast<DeferredElements *>(this->elements.front())->expand(resource(), elements);
+    }
+    this->elements.assign(elements.begin(), elements.end());
+    this->deferred = Deferred::NO;
+}
+
+Container *Container::findIndexed(std::string_view id) {
+    if (this->index == nullptr)
+        this->index = create<Index>(resource(), resource());
+    if (!this->index->valid)
+        buildIndex();
+
+    auto &slots = this->index->slots;
+    size_t mask = slots.size() - 1;
+    for (size_t i = std::hash<std::string_view>()(id) & mask; ; i = (i + 1) & mask) {
+        auto container = slots[i];
+        if (container == nullptr || container->id == id)
+            return container;
+    }
+}
+
+void Container::buildIndex() {
+    size_t count = 0;
+    for (auto element : this->elements) {
+        if (element->isContainer())
+            ++count;
+    }
+
+    // use at most half of the slots
+    this->index->slots.assign(std::bit_ceil(count * 2 + 2), nullptr);
+    this->index->count = 0;
+    this->index->valid = true;
+    for (auto element : this->elements) {
+        auto container = element->asContainer();
+        if (container != nullptr)
+            insertIndex(container);
+    }
+}
+
+void Container::insertIndex(Container *container) {
+    auto &slots = this->index->slots;
+    if ((this->index->count + 1) * 2 > slots.size()) {
+        // full: rebuild with more slots on next find
+        this->index->valid = false;
+        return;
+    }
+
+    // only insert the first container of each id
+    size_t mask = slots.size() - 1;
+    for (size_t i = std::hash<std::string_view>()(container->id) & mask; ; i = (i + 1) & mask) {
+        auto c = slots[i];
+        if (c == nullptr) {
+            slots[i] = container;
+            ++this->index->count;
+            return;
+        }
+        if (c->id == container->id)
+            return;
+    }
 }
 
-void Container::newLine(std::ostream &s, int indent) {
-    s << std::endl;
-    for (int i = 0; i < indent; ++i) {
-        s << "  ";
+std::string_view Container::copy(std::string_view str) {
+    return kicad::copy(resource(), str);
+}
+
+
+
+// CountingResource
+
+void *CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void *p = this->upstream->allocate(bytes, alignment);
+    size_t allocated = this->allocated += bytes;
+    size_t maxAllocated = this->maxAllocated;
+    while (allocated > maxAllocated && !this->maxAllocated.compare_exchange_weak(maxAllocated, allocated));
+    return p;
+}
+
+void CountingResource::do_deallocate(void *p, size_t bytes, size_t alignment) {
+    this->upstream->deallocate(p, bytes, alignment);
+    this->allocated -= bytes;
+}
+
+
+// Document
+
+Document::Document()
+    : root({}, &this->arena)
+{
+}
+
+Document::~Document() {
+}
+
+void Document::clear() {
+    clearElements(*this);
+    this->text = {};
+    this->buffer = {};
+    this->source.close();
+}
+
+std::pair<std::string_view, Atom> Document::internId(std::string_view id) {
+    return kicad::intern(this->strings, &this->arena, id);
+}
+
+
+// DeferredElements
+
+DeferredElements::~DeferredElements() {
+}
+
+uint64_t DeferredElements::getHash() {
+    return 0;
+}
+
+
+// Visitor
+
+Visitor::~Visitor() {
+}
+
+bool Visitor::beginContainer(std::string_view /*id*/, Atom /*atom*/, int /*depth*/) {
+    return true;
+}
+
+void Visitor::value(std::string_view /*value*/, int /*depth*/) {
+}
+
+void Visitor::endContainer(int /*depth*/) {
+}
+
+
+// Builder
+
+Builder::Builder(Document &document) : document(document) {
+    document.clear();
+}
+
+Builder::~Builder() {
+}
+
+bool Builder::beginContainer(std::string_view id, Atom atom, int depth) {
+    Container *container;
+    if (depth == 0) {
+        container = &this->document.root;
+    } else {
+        auto resource = this->document.resource();
+        container = create<Container>(resource, std::string_view(), atom, resource);
+        this->elements.push_back(container);
     }
+    container->id = this->document.intern(id);
+    container->atom = atom;
+
+    // collect elements on a stack and copy them into an array of exact size when the container is complete
+    this->containers.push_back(container);
+    this->marks.push_back(this->elements.size());
+    return true;
 }
 
+void Builder::value(std::string_view value, int /*depth*/) {
+    auto resource = this->document.resource();
+    this->elements.push_back(create<Value>(resource, copy(resource, value)));
+}
+
+void Builder::endContainer(int /*depth*/) {
+    auto container = this->containers.back();
+    size_t mark = this->marks.back();
+    container->elements.assign(this->elements.begin() + mark, this->elements.end());
+    this->elements.resize(mark);
+    this->containers.pop_back();
+    this->marks.pop_back();
+}
 
 
-void readFile(std::istream &s, Container &kicad) {
+void visitFile(std::istream &s, Visitor &visitor, const std::vector<Path> &paths) {
     Tokenizer t(s);
+    Walker w(t, visitor, paths);
+    w.visitFile();
+}
+
+bool visitFile(const std::filesystem::path &path, Visitor &visitor, const std::vector<Path> &paths) {
+    MappedFile file;
+    if (file.open(path)) {
+        Tokenizer t(file.data());
+        Walker w(t, visitor, paths);
+        w.visitFile();
+        return true;
+    }
+
+    // fall back to stream (e.g. for pipes)
+    std::ifstream s(path, std::ios::binary);
+    if (!s)
+        return false;
+    visitFile(s, visitor, paths);
+    return true;
+}
+
+
+void readFile(std::istream &s, Document &document, const ReadOptions &options) {
+    document.clear();
+    if (options.threadCount != 1 || options.lazy) {
+        // parallel and lazy parsing need the whole file in memory
+        document.buffer.assign(std::istreambuf_iterator<char>(s), {});
+        document.text = document.buffer;
+        readText(document, options);
+        return;
+    }
+
+    Tokenizer t(s);
+    Reader r(t, document.resource(), &document.strings, false);
+    r.readFile(document.root);
+}
+
+bool readFile(const std::filesystem::path &path, Document &document, const ReadOptions &options) {
+    document.clear();
+
+    // try to map the file into memory, the document keeps the mapping and values reference it
+    if (document.source.open(path)) {
+        document.text = document.source.data();
+        readText(document, options);
+        return true;
+    }
 
-    // file starts with a container
-    auto token = t.getToken();
-    if (token == Token::CONTAINER)
-        readContainer(t, kicad);
+    // fall back to stream (e.g. for pipes)
+    std::ifstream s(path, std::ios::binary);
+    if (!s)
+        return false;
+    readFile(s, document, options);
+    return true;
 }
 
 } // namespace kicad
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "mapped_file.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
 #include <istream>
 #include <ostream>
 #include <list>
 #include <map>
+#include <memory_resource>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -15,44 +22,226 @@ namespace kicad {
 //std::string toString(std::string_view value);
 
 
+/// @brief Keywords of the kicad file format, used as ids of containers so that they can be compared as integers
+///
+enum class Atom : uint16_t {
+    // not a known keyword
+    NONE,
+
+    ANGLE,
+    ARC,
+    AT,
+    ATTR,
+    CENTER,
+    CHAMFER,
+    CHAMFER_RATIO,
+    CLEARANCE,
+    CONNECT,
+    DESCR,
+    DRILL,
+    EFFECTS,
+    EMBEDDED_FONTS,
+    END,
+    FILL,
+    FILLED_AREAS_THICKNESS,
+    FILLED_POLYGON,
+    FONT,
+    FOOTPRINT,
+    FP_ARC,
+    FP_CIRCLE,
+    FP_CURVE,
+    FP_LINE,
+    FP_POLY,
+    FP_RECT,
+    FP_TEXT,
+    GENERAL,
+    GENERATOR,
+    GENERATOR_VERSION,
+    GR_ARC,
+    GR_CIRCLE,
+    GR_CURVE,
+    GR_LINE,
+    GR_POLY,
+    GR_RECT,
+    GR_TEXT,
+    GROUP,
+    HATCH,
+    HIDE,
+    ISLAND,
+    JUSTIFY,
+    KICAD_PCB,
+    LAYER,
+    LAYERS,
+    LAYERSELECTION,
+    MID,
+    MIN_THICKNESS,
+    MODEL,
+    NET,
+    NET_NAME,
+    OFFSET,
+    OUTPUTDIRECTORY,
+    PAD,
+    PAD_TO_MASK_CLEARANCE,
+    PAPER,
+    PATH,
+    PCBPLOTPARAMS,
+    PLOT_ON_ALL_LAYERS_SELECTION,
+    POLYGON,
+    PRIMITIVES,
+    PRIORITY,
+    PROPERTY,
+    PTS,
+    RECT_DELTA,
+    REV,
+    ROTATE,
+    ROUNDRECT_RRATIO,
+    SCALE,
+    SEGMENT,
+    SETUP,
+    SHEETFILE,
+    SHEETNAME,
+    SIZE,
+    SOLDER_MASK_MARGIN,
+    SOLDER_PASTE_MARGIN,
+    STACKUP,
+    START,
+    STROKE,
+    TAGS,
+    TEARDROP,
+    THERMAL_BRIDGE_WIDTH,
+    THERMAL_GAP,
+    THICKNESS,
+    TITLE,
+    TITLE_BLOCK,
+    TSTAMP,
+    TYPE,
+    UNLOCKED,
+    UUID,
+    VERSION,
+    VIA,
+    WIDTH,
+    XY,
+    XYZ,
+    ZONE,
+    ZONE_CONNECT
+};
+
+/// @brief Get the atom of a keyword
+/// @param keyword Keyword, e.g. "footprint"
+/// @return Atom or Atom::NONE if the keyword is not known
+Atom toAtom(std::string_view keyword);
+
+/// @brief Get the keyword of an atom
+/// @param atom Atom
+/// @return Keyword, e.g. "footprint"
+std::string_view toString(Atom atom);
+
+
+class Value;
+class Container;
+
+
+/// @brief Base class of all elements. The kind tag tells values from containers, elements are not polymorphic and
+/// live in the arena of a kicad::Document
 class Element {
 public:
-    enum class Action {
+    enum class Kind : uint8_t {
+        VALUE,
+        CONTAINER,
+    };
+
+    enum class Action : uint8_t {
         NONE,
         KEEP,
         DELETE,
     };
 
-    Element() = default;
+    Element(Kind kind) : kind(kind) {}
     Element(Element &&other) = default;
-    virtual ~Element();
-    virtual int count() = 0;
-    virtual Action sweep();
-    virtual void write(std::ostream &s, int indent) = 0;
 
+    bool isValue() const {return this->kind == Kind::VALUE;}
+    bool isContainer() const {return this->kind == Kind::CONTAINER;}
+
+    /// @brief Cast to kicad::Value
+    /// @return Value or nullptr if the element is not a value
+    Value *asValue();
+
+    /// @brief Cast to kicad::Container
+    /// @return Container or nullptr if the element is not a container
+    Container *asContainer();
+
+    int count();
+    Action sweep();
+    void write(std::ostream &s, int indent);
+
+    Kind kind;
     Action action = Action::NONE;
 };
 
 
 class Value : public Element {
+protected:
+    enum class Parsed : uint8_t {
+        NO,
+        NUMBER,
+        NOT_A_NUMBER,
+    };
+
+    // state of the cached number, fits into the padding after the element members
+    Parsed parsed = Parsed::NO;
+
 public:
-    Value() = default;
-    Value(std::string_view value) : value(value) {}
+    Value() : Element(Kind::VALUE) {}
+    Value(std::string_view value) : Element(Kind::VALUE), value(value) {}
     Value(Value &&other) = default;
 
-    ~Value() override;
-    int count() override;
-    void write(std::ostream &s, int indent) override;
+    int count() {return 1;}
+    void write(std::ostream &s, int indent);
 
     std::string getString(std::string_view defaultValue = {});
 
-    void setString(std::string_view value);
+    /// @brief Get the value as number. The result gets cached, therefore repeated calls do not parse again
+    /// @param number Receives the number
+    /// @return true if the value is a number
+    bool getNumber(double &number) {
+        if (this->parsed == Parsed::NO)
+            parseNumber();
+        number = this->number;
+        return this->parsed == Parsed::NUMBER;
+    }
+
+
+    /// @brief Value as in the file (including quotes), references the source file or memory of the document
+    std::string_view value;
+
+protected:
+    void parseNumber();
+
+    // cached number
+    double number = 0.0;
+};
 
 
-    std::string value;
+/// @brief Placeholder for the elements of a deferred container that creates them on first access
+///
+class DeferredElements : public Value {
+public:
+    virtual ~DeferredElements();
+
+    /// @brief Create the elements
+    /// @param resource Memory resource of the container
+    /// @param elements Receives the elements
+    virtual void expand(std::pmr::memory_resource *resource, std::vector<Element *> &elements) = 0;
+
+    /// @brief Get the hash of the source text of the elements (see hash64())
+    /// @return Hash or 0 if unknown
+    virtual uint64_t getHash();
 };
 
 
+/// @brief Container with an id and elements. The elements are an array of pointers to elements in the arena of the
+/// document, allocated with the exact size when the container is complete. Nodes are not stored in a flat array,
+/// only snapshots use one (see writeSnapshot())
 class Container : public Element {
 public:
     template <typename T>
@@ -62,15 +251,26 @@ public:
     };
 
 
-    Container() = default;
-    Container(std::string_view id) : id(id) {}
+    using Elements = std::pmr::vector<Element *>;
+
+    /// @brief Constructor
+    /// @param id Id of the container, must stay valid as long as the container exists
+    /// @param resource Memory resource for the elements, usually the memory of a kicad::Document
+    Container(std::string_view id, std::pmr::memory_resource *resource)
+        : Element(Kind::CONTAINER), atom(toAtom(id)), id(id), elements(resource) {}
+
+    /// @brief Constructor
+    /// @param id Id of the container, must stay valid as long as the container exists
+    /// @param atom Atom of the id
+    /// @param resource Memory resource for the elements, usually the memory of a kicad::Document
+    Container(std::string_view id, Atom atom, std::pmr::memory_resource *resource)
+        : Element(Kind::CONTAINER), atom(atom), id(id), elements(resource) {}
     Container(const Container &) = delete;
     Container(Container &&other) = default;
 
-    virtual ~Container();
-    int count() override;
-    Action sweep() override;
-    void write(std::ostream &s, int indent) override;
+    int count();
+    Action sweep();
+    void write(std::ostream &s, int indent);
 
 
 
@@ -79,7 +279,7 @@ public:
 
     /// @brief Add a new element
     /// @param element
-    void add(Element *element) {this->elements.push_back(element);}
+    void add(Element *element);
 
 
 
@@ -140,6 +340,11 @@ public:
     /// @return The new container
     Container *add(std::string_view id);
 
+    /// @brief Add a new container
+    /// @param atom Id of container
+    /// @return The new container
+    Container *add(Atom atom);
+
     /// @brief Add a value to the container
     /// @param value Value to add
     /// @return *this
@@ -170,12 +375,14 @@ public:
     /// @param index Index
     /// @return Element if the element exists and is of type kicad::Value, otherwise nullptr
     Value *getValue(int index) {
+        expand();
+
         // check index
         if (unsigned(index) >= this->elements.size())
             return nullptr;
 
         // check if element is of type Value
-        return dynamic_cast<Value *>(this->elements[index]);
+        return this->elements[index]->asValue();
     }
 
     /// @brief Get a tag at given index (string without quotes ).
@@ -202,6 +409,21 @@ public:
     /// @return Number value at given index
     double getNumber(int index, double defaultValue = 0.0);
 
+    /// @brief Get an int value without throwing exceptions
+    /// @param index Index of value
+    /// @param number Receives the number
+    /// @return true if there is a value at the given index that is an int
+    bool tryGetInt(int index, int &number);
+
+    /// @brief Get a number value without throwing exceptions, the parsed number gets cached in the value
+    /// @param index Index of value
+    /// @param number Receives the number
+    /// @return true if there is a value at the given index that is a number
+    bool tryGetNumber(int index, double &number) {
+        auto value = getValue(index);
+        return value != nullptr && value->getNumber(number);
+    }
+
 // find
     /// @brief Check if the container contains a tag.
     /// @param tag Tag to find
@@ -213,30 +435,40 @@ public:
     /// @return Container or nullptr if not found or not of type Container
     Container *find(std::string_view id);
 
+    /// @brief Find element container with given atom.
+    /// @param atom Atom of sub-container to find
+    /// @return Container or nullptr if not found
+    Container *find(Atom atom);
+
     /// @brief Find or add element container with given id.
     /// @param id id of sub-container to find
     /// @return Found or new container
     Container *findOrAdd(std::string_view id);
+    Container *findOrAdd(Atom atom);
 
     /// @brief Find element container with given id and return its first value as string.
     /// @param id id of sub-container to find
     /// @return value or empty string if not found
-    std::string findString(std::string_view id);
+    std::string findString(std::string_view id) {return stringOf(find(id));}
+    std::string findString(Atom atom) {return stringOf(find(atom));}
 
     /// @brief Find element container with given id and return its first value as number.
     /// @param id id of sub-container to find
     /// @return value or zero if not found
-    double findNumber(std::string_view id);
+    double findNumber(std::string_view id) {return numberOf(find(id));}
+    double findNumber(Atom atom) {return numberOf(find(atom));}
 
     /// @brief Find element container with given id and return its first and second value as string.
     /// @param id id of sub-container to find
     /// @return values or empty strings if not found
-    Value2<std::string> findString2(std::string_view id);
+    Value2<std::string> findString2(std::string_view id) {return string2Of(find(id));}
+    Value2<std::string> findString2(Atom atom) {return string2Of(find(atom));}
 
     /// @brief Find element container with given id and return its first and second value as number.
     /// @param id id of sub-container to find
     /// @return values or zeros if not found
-    Value2<double> findNumber2(std::string_view id);
+    Value2<double> findNumber2(std::string_view id) {return number2Of(find(id));}
+    Value2<double> findNumber2(Atom atom) {return number2Of(find(atom));}
 
 // helpers
 
@@ -268,24 +500,34 @@ public:
     /// @param element Element to erase
     void erase(Element *element);
 
-    /// @brief Erase element by id.
-    /// @param element Element to erase
+    /// @brief Erase elements by id.
+    /// @param id Id of the containers to erase
     void erase(std::string_view id);
 
+    /// @brief Erase elements by atom.
+    /// @param atom Atom of the containers to erase
+    void erase(Atom atom);
+
+    /// @brief Set the id (and atom) of the container
+    /// @param id New id
+    void setId(std::string_view id);
 
-    static void newLine(std::ostream &s, int indent);
 
 
 
     class Iterator {
     public:
-        Iterator(std::vector<Element *>::iterator it, std::vector<Element *>::iterator end)
-            : it(it), end(end)
+        /// @brief Constructor
+        /// @param it Start of the elements
+        /// @param end End of the elements
+        /// @param atom Only iterate over containers with this atom, Atom::NONE iterates over all containers
+        Iterator(Elements::iterator it, Elements::iterator end, Atom atom = Atom::NONE)
+            : it(it), end(end), atom(atom)
         {
             nextContainer();
         }
 
-        Iterator(std::vector<Element *>::iterator end)
+        Iterator(Elements::iterator end)
             : it(end), end(end)
         {
         }
@@ -306,28 +548,287 @@ public:
 
     protected:
         void nextContainer() {
-            while (this->it != this->end && dynamic_cast<Container *>(*this->it) == nullptr) {
+            while (this->it != this->end && !matches(*this->it)) {
                 ++this->it;
             }
         }
 
-        std::vector<Element *>::iterator it;
-        std::vector<Element *>::iterator end;
+        bool matches(Element *element) {
+            return element->isContainer()
+                && (this->atom == Atom::NONE || static_cast<Container *>(element)->atom == this->atom);
+        }
+
+        Elements::iterator it;
+        Elements::iterator end;
+        Atom atom;
+    };
+
+    struct Range {
+        Iterator b;
+        Iterator e;
+        Iterator begin() {return this->b;}
+        Iterator end() {return this->e;}
     };
 
-    Iterator begin() {return {this->elements.begin(), this->elements.end()};}
+    Iterator begin() {expand(); return {this->elements.begin(), this->elements.end()};}
     Iterator end() {return this->elements.end();}
 
+    /// @brief Select all sub-containers with given atom, e.g. for (auto pad : footprint->select(Atom::PAD))
+    /// @param atom Atom of the sub-containers
+    /// @return Range for iteration
+    Range select(Atom atom) {
+        expand();
+        return {{this->elements.begin(), this->elements.end(), atom}, this->elements.end()};
+    }
+
+    /// @brief Invalidate the index of sub-containers that find() builds for containers with many elements. Only
+    /// needed after modifying the elements member directly or changing the id of a sub-container
+    void invalidateIndex() {
+        if (this->index != nullptr)
+            this->index->valid = false;
+    }
 
+    /// @brief Check if the elements were skipped when reading the file (see ReadOptions::lazy)
+    bool isDeferred() const {return this->deferred != Deferred::NO;}
 
-    std::string id;
-    std::vector<Element *> elements;
+    /// @brief Get the text of the elements if they were skipped when reading the file (see ReadOptions::lazy)
+    /// @return Text that references the document or empty if the elements are present or get created otherwise
+    std::string_view getDeferredText() const {
+        if (this->deferred != Deferred::TEXT)
+            return {};
+        return static_cast<const Value *>(this->elements.front())->value;
+    }
+
+    /// @brief Get the hash of the text of the elements if they were not created yet. Containers read from the text and
+    /// from a snapshot of it have the same hash, e.g. to detect changed footprints
+    /// @return hash64() of the text or 0 if the elements are present or the hash is unknown
+    uint64_t getDeferredHash();
+
+    /// @brief Parse the elements if they were skipped when reading the file. All methods of the container do this
+    /// automatically, only call it before accessing the elements member directly. Not thread safe.
+    void expand() {
+        if (this->deferred != Deferred::NO)
+            expandDeferred();
+    }
+
+    enum class Deferred : uint8_t {
+        // elements are present
+        NO,
+
+        // elements were skipped when reading the file, the only element is a value that contains their text
+        TEXT,
+
+        // the only element is a DeferredElements that creates the elements (e.g. from a snapshot)
+        CUSTOM
+    };
+
+    // atom of the id, Atom::NONE if the id is not a known keyword
+    Atom atom;
+
+    Deferred deferred = Deferred::NO;
+
+
+
+    std::string_view id;
+    Elements elements;
+
+protected:
+    // hash index of the sub-containers by id, built on demand by find() for containers with many elements
+    struct Index {
+        Index(std::pmr::memory_resource *resource) : slots(resource) {}
+
+        // open addressing hash table that contains the first container of each id
+        std::pmr::vector<Container *> slots;
+        size_t count = 0;
+        bool valid = false;
+    };
+
+    void expandDeferred();
+    Container *findIndexed(std::string_view id);
+    void buildIndex();
+    void insertIndex(Container *container);
+
+    std::pmr::memory_resource *resource() {return this->elements.get_allocator().resource();}
+    std::string_view copy(std::string_view str);
+
+    static std::string stringOf(Container *container);
+    static double numberOf(Container *container);
+    static Value2<std::string> string2Of(Container *container);
+    static Value2<double> number2Of(Container *container);
+
+    Index *index = nullptr;
+};
+
+
+inline Value *Element::asValue() {
+    return isValue() ? static_cast<Value *>(this) : nullptr;
+}
+
+inline Container *Element::asContainer() {
+    return isContainer() ? static_cast<Container *>(this) : nullptr;
+}
+
+
+/// @brief Memory resource that counts the bytes allocated from an upstream resource. Used as upstream of the arenas
+/// of a document to measure the memory of the tree. Thread safe if the upstream resource is thread safe
+class CountingResource : public std::pmr::memory_resource {
+public:
+    CountingResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) : upstream(upstream) {}
+
+    /// @brief Number of bytes that are currently allocated
+    size_t size() const {return this->allocated;}
+
+    /// @brief Maximum number of bytes that were allocated at the same time
+    size_t peak() const {return this->maxAllocated;}
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {return this == &other;}
+
+    std::pmr::memory_resource *upstream;
+    std::atomic<size_t> allocated = 0;
+    std::atomic<size_t> maxAllocated = 0;
+};
+
+
+/// @brief Kicad document. Owns all elements and strings of a file in an arena and frees them in one step.
+///
+class Document {
+public:
+    Document();
+    Document(const Document &) = delete;
+    ~Document();
+
+    /// @brief Remove all elements and release the memory
+    void clear();
+
+    /// @brief Store a string in the document, identical strings get stored only once
+    /// @param str String to store
+    /// @return String stored in the document
+    std::string_view intern(std::string_view str) {return internId(str).first;}
+
+    /// @brief Store a container id in the document and look up its atom
+    /// @param id Id to store
+    /// @return Id stored in the document and its atom
+    std::pair<std::string_view, Atom> internId(std::string_view id);
+
+    /// @brief Get the memory resource of the document, all memory gets released when the document is cleared
+    std::pmr::memory_resource *resource() {return &this->arena;}
+
+    // counts the memory of the arenas
+    CountingResource memory;
+
+    // memory for elements and strings
+    std::pmr::monotonic_buffer_resource arena{&this->memory};
+
+    // additional memory for elements that were parsed in parallel
+    std::deque<std::pmr::monotonic_buffer_resource> arenas;
+
+    // interned strings (e.g. container ids) and their atoms
+    std::unordered_map<std::string_view, Atom> strings;
+
+    // memory mapped source file, values reference it
+    MappedFile source;
+
+    // copy of the file if it was read from a stream and needs to be kept in memory
+    std::string buffer;
+
+    // text of the file if it is kept in memory (either the memory mapped file or the buffer)
+    std::string_view text;
+
+    // root container (e.g. kicad_pcb)
+    Container root;
 };
 
 
+/// @brief Options for reading kicad files
+struct ReadOptions {
+    /// @brief Number of threads that parse the top level elements (e.g. footprints, segments and zones) in parallel,
+    /// 0 to use all cores. Parallel parsing splits the file at lines that have the indentation of the first top level
+    /// element and falls back to serial parsing if the file is not formatted like this.
+    int threadCount = 1;
+
+    /// @brief Only record the text of top level containers (e.g. footprints, segments and zones) and parse it when
+    /// the container gets accessed for the first time. Containers that never get accessed cost only a scan over
+    /// their text. The document keeps the whole file in memory.
+    bool lazy = false;
+};
+
 /// @brief Read a kicad file
 /// @param buffer buffer of an open file or network socket that is in ready state
-void readFile(std::istream &s, Container &kicad);
+/// @param document Document to read into, gets cleared first
+/// @param options Options, reading in parallel or lazily requires to read the whole stream into the document first
+void readFile(std::istream &s, Document &document, const ReadOptions &options = {});
+
+/// @brief Read a kicad file. Regular files are memory mapped and values reference the mapping, other files
+/// (e.g. pipes) are read as stream
+/// @param path Path of the file
+/// @param document Document to read into, gets cleared first
+/// @param options Options
+/// @return true if the file could be opened
+bool readFile(const std::filesystem::path &path, Document &document, const ReadOptions &options = {});
+
+/// @brief Receives the elements of a kicad file while it gets scanned by visitFile() without building a tree
+///
+class Visitor {
+public:
+    virtual ~Visitor();
+
+    /// @brief Called at the begin of a container
+    /// @param id Id of the container, only valid during the call
+    /// @param atom Atom of the id
+    /// @param depth Depth of the container, 0 for the root container
+    /// @return true to visit the elements of the container, false to skip them
+    virtual bool beginContainer(std::string_view id, Atom atom, int depth);
+
+    /// @brief Called for each value of a visited container
+    /// @param value Value as in the file (including quotes), only valid during the call
+    /// @param depth Depth of the container that contains the value
+    virtual void value(std::string_view value, int depth);
+
+    /// @brief Called at the end of a visited container
+    /// @param depth Depth of the container
+    virtual void endContainer(int depth);
+};
+
+/// @brief Path of atoms from the root container to a sub-container, e.g. {Atom::FOOTPRINT, Atom::PAD}
+using Path = std::vector<Atom>;
+
+/// @brief Visitor that builds the visited containers into a document, e.g. to keep only the footprints of a board
+///
+class Builder : public Visitor {
+public:
+    /// @brief Constructor
+    /// @param document Document to build, gets cleared
+    Builder(Document &document);
+    ~Builder() override;
+
+    bool beginContainer(std::string_view id, Atom atom, int depth) override;
+    void value(std::string_view value, int depth) override;
+    void endContainer(int depth) override;
+
+protected:
+    Document &document;
+    std::vector<Container *> containers;
+    std::vector<size_t> marks;
+    std::vector<Element *> elements;
+};
+
+/// @brief Scan a kicad file and report its elements to a visitor
+/// @param s Input stream
+/// @param visitor Visitor
+/// @param paths Only visit containers on these paths and their sub-containers, all containers if empty. The root
+/// container gets always visited.
+void visitFile(std::istream &s, Visitor &visitor, const std::vector<Path> &paths = {});
+
+/// @brief Scan a kicad file and report its elements to a visitor
+/// @param path Path of the file, gets memory mapped if possible
+/// @param visitor Visitor
+/// @param paths Only visit containers on these paths and their sub-containers, all containers if empty. The root
+/// container gets always visited.
+/// @return true if the file could be opened
+bool visitFile(const std::filesystem::path &path, Visitor &visitor, const std::vector<Path> &paths = {});
 
 /// @brief Write a kicad file
 /// @param buffer buffer of an open file or network socket that is in ready state
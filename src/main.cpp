@@ -1,15 +1,33 @@
 #include "kicad.hpp"
+#include "excellon.hpp"
+#include "file_watcher.hpp"
+#include "footprints.hpp"
+#include "hash.hpp"
+#include "process.hpp"
+#include "profiler.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "tokenizer.hpp"
+#include "zip_writer.hpp"
 #include <nlohmann/json.hpp>
-#include <libzippp/libzippp.h> // https://github.com/ctabin/libzippp
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <numbers>
+#include <optional>
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
-using namespace libzippp;
 using std::numbers::pi;
 
 
@@ -55,16 +73,11 @@ void substituteVariables(std::string &str, const std::map<std::string, std::stri
     }
 }
 
-// extract type of a component, e.g. "R" from "R1"
-std::string getType(std::string_view reference) {
-    size_t i = 0;
-    while (i < reference.length()) {
-        char ch = reference[i];
-        if (ch >= '0' && ch <= '9')
-            break;
-        ++i;
-    }
-    return std::string(reference.substr(0, i));
+// format a number in shortest form, e.g. "1.5"
+std::string formatNumber(double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
 }
 
 // manufacturer
@@ -91,706 +104,1135 @@ struct Job {
     fs::path pcbPath;
 };
 
-struct BomKey {
-    std::string type;
-    std::string value;
-    int voltage; // in mV
-    std::string footprint;
-    std::string manufacturer;
-    std::string mpn;
+// cached state of a job, stored in the output directory to skip jobs whose inputs and outputs did not change
+struct CacheEntry {
+    // hash of the inputs (board, text variables and job settings)
+    uint64_t key = 0;
 
-    auto operator <=>(const BomKey& other) const noexcept = default;
+    // hashes of the output files by file name
+    std::map<std::string, uint64_t> outputs;
 };
 
-struct BomValue {
-    std::vector<std::string> references; // list of references (e.g. R1, R2, C1...)
-    int padCount;
-    bool throughHole;
-    std::string description;
-};
+// cache entries by job name
+using Cache = std::map<std::string, CacheEntry>;
+
+// version of the cache, increment when the outputs for the same inputs change
+constexpr uint64_t CACHE_VERSION = 1;
+
+// read the cache, returns an empty cache if the file does not exist or is invalid
+Cache loadCache(const fs::path &path) {
+    Cache cache;
+    std::ifstream is(path.string());
+    if (is.is_open()) {
+        try {
+            json j = json::parse(is);
+            if (j.at("version") != CACHE_VERSION)
+                return cache;
+            json jobs = j.at("jobs");
+            for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+                auto &entry = cache[it.key()];
+                entry.key = std::stoull(it->at("key").get<std::string>(), nullptr, 16);
+                json outputs = it->at("outputs");
+                for (auto it2 = outputs.begin(); it2 != outputs.end(); ++it2)
+                    entry.outputs[it2.key()] = std::stoull(it2->get<std::string>(), nullptr, 16);
+            }
+        } catch (std::exception &e) {
+            cache.clear();
+        }
+    }
+    return cache;
+}
 
-struct JlcBomKey {
-    std::string type;
-    std::string value;
-    std::string footprintName;
-    std::string lcscPn;
+// write the cache
+bool saveCache(const fs::path &path, const Cache &cache) {
+    json jobs = json::object();
+    for (auto &[name, entry] : cache) {
+        json outputs = json::object();
+        for (auto &[fileName, hash] : entry.outputs)
+            outputs[fileName] = toHex(hash);
+        jobs[name] = {{"key", toHex(entry.key)}, {"outputs", outputs}};
+    }
+    std::ofstream os(path.string());
+    os << json{{"version", CACHE_VERSION}, {"jobs", jobs}}.dump(2) << std::endl;
+    return bool(os);
+}
 
-    auto operator <=>(const JlcBomKey& other) const noexcept = default;
+// output of a job, gets buffered so that the output of jobs running in parallel does not mix
+struct JobLog {
+    std::ostringstream out;
+    int errorCount = 0;
+
+    // job was skipped because inputs and outputs are unchanged
+    bool skipped = false;
+
+    // new cache entry, valid if the job ran without errors
+    CacheEntry cacheEntry;
+
+    // start an error message
+    std::ostream &error() {
+        ++this->errorCount;
+        this->out << "Error: ";
+        return this->out;
+    }
 };
 
+// state of a job that is kept in memory between runs in watch mode
+struct JobState {
+    // board and hash of the file it was read from, null if not read yet
+    std::unique_ptr<kicad::Document> document;
+    uint64_t pcbHash = 0;
 
-/// @brief BOM Tool: Zip gerber files and create BOM and CPL files
-///
-/// Usage:
-/// bom-tool <options> <path to .kicad_pcb file> <output directory>
-/// Options:
-///   -n Name for output files (optional, derived from .kicad_pcb file name if not given)
-///   -g Export and zip gerber files (path to gerber and layers are read from the .kicad_pcb file)
-///   -b Generate BOM and placement file
-///   -j Generate for JLCPCB (oval holes alternate, BOM with LCSC PN, CPL)
-///
-/// Multiple pcb files can be processed in one go
-int main(int argc, const char **argv) {
-    if (argc < 2)
-        return 1;
+    // board of the run before, kept while the footprints get extracted so that FootprintTable::build() can reuse the
+    // unchanged footprints of the previous table whose strings point into this board. Gets released after the
+    // outputs are done
+    std::unique_ptr<kicad::Document> previousDocument;
 
-    // parse arguments
-    std::string name;
-    bool gerber = false;
-    bool bom = false;
-    bool drill = false;
-    Manufacturer manufacturer = Manufacturer::GENERIC;
-    std::list<Job> jobs;
+    // footprints of the board
+    kicad::FootprintTable footprints;
+
+    // hashes of the inputs of the BOM/CPL and OpenSCAD drill files of the previous run, 0 if they were not written
+    uint64_t bomKey = 0;
+    uint64_t drillKey = 0;
+};
+
+// options that apply to all jobs
+struct Options {
     fs::path outDir;
-    for (int i = 1; i < argc; ++i) {
-        std::string_view arg = argv[i];
-        if (arg == "-n") {
-            // set name of current job
-            ++i;
-            name = argv[i];
-        } else if (arg == "-g") {
-            // zip gerber
-            gerber = true;
-        } else if (arg == "-b") {
-            // create generic bom (includes voltage)
-            bom = true;
-        } else if (arg == "-j") {
-            // JLCPCB
-            manufacturer = Manufacturer::JLCPCB;
-        } else if (arg == "-d") {
-            // export drill
-            drill = true;
-        } else {
-            if (gerber || bom || drill) {
-                // argument is path to .kicad_pcb file: add job
-                fs::path pcbPath = arg;
-                if (name.empty())
-                    name = pcbPath.stem().string();
+    kicad::ReadOptions readOptions;
+    bool stream;
 
-                jobs.emplace_back(name, gerber, bom, manufacturer, drill, pcbPath);
+    // compression level for zip files, 0 to store
+    int compressionLevel;
 
-                // clear
-                name.clear();
-                gerber = false;
-                bom = false;
-                drill = false;
-            } else {
-                // argument is output directory
-                outDir = arg;
+    // create identical zip files for identical gerber files
+    bool reproducible;
+
+    // write Excellon drill files without kicad-cli
+    bool nativeDrill;
+
+    // read the board from a binary snapshot next to the .kicad_pcb file, create it if it is missing or outdated
+    bool snapshot;
+
+    // print details such as per-entry timing of zip files
+    bool verbose;
+
+    // print memory statistics of each job
+    bool stats;
+
+    // records the timing of phases and subprocesses, null if profiling is disabled
+    Profiler *profiler;
+
+    // cache of previous runs, ignored if force is set
+    const Cache *cache;
+    bool force;
+
+    // keep the board of each job in memory and run the jobs again when their files change
+    bool watch;
+};
+
+// get the size of a file for profiling, 0 if it does not exist
+int64_t getFileSize(const fs::path &path) {
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    return ec ? 0 : int64_t(size);
+}
+
+// run a process and record it in the profiler
+ProcessResult runProfiledProcess(Profiler *profiler, std::string_view name,
+    const std::vector<std::string> &arguments)
+{
+    ProfileScope scope(profiler, name, "process");
+    auto result = runProcess(arguments);
+    scope.arg("exitCode", result.exitCode);
+    scope.arg("outputBytes", int64_t(result.output.size()));
+    return result;
+}
+
+// run a job, output and errors go to the log. The state keeps the board for the next run in watch mode
+void runJob(const Job &job, const Options &options, JobState &state, JobLog &log) {
+    auto &outDir = options.outDir;
+    auto &readOptions = options.readOptions;
+    auto stream = options.stream;
+    auto profiler = options.profiler;
+    ProfileScope jobScope(profiler, job.name, "job");
+    jobScope.arg("pcb", job.pcbPath.string());
+
+    const char *manufacturers[] = {"Generic", "JLCPCB"};
+    log.out << "*** " << job.name << " for " << manufacturers[int(job.manufacturer)] << " ***" << std::endl;
+
+    // try to read project (.kicad_pro) file for variables
+    std::map<std::string, std::string> variables;
+    {
+        ProfileScope scope(profiler, "read project");
+        fs::path projectPath = job.pcbPath;
+        projectPath.replace_extension(".kicad_pro");
+        std::ifstream is(projectPath.string());
+        if (is.is_open()) {
+            scope.arg("bytesRead", getFileSize(projectPath));
+            try {
+                json j = json::parse(is);
+                json vars = j.at("text_variables");
+                for (auto it = vars.begin(); it != vars.end(); ++it) {
+                    std::string key = it.key();
+                    std::string value = it.value();
+                    variables[key] = value;
+                }
+            } catch (std::exception &e) {
             }
         }
     }
 
-    std::cout << "Output directory: " << outDir.string() << std::endl;
+    // hash the pcb file for the cache and the snapshot
+    ProfileScope hashScope(profiler, "hash board", "io");
+    uint64_t pcbHash = 0;
+    bool pcbHashed = hashFile(job.pcbPath, pcbHash);
+    hashScope.arg("bytesRead", getFileSize(job.pcbPath));
+    hashScope.end();
+
+    // hash the inputs: job settings, zip options, variables and pcb file
+    uint64_t key = 0;
+    {
+        std::string inputs = job.name + '\n' + job.pcbPath.string() + '\n';
+        inputs += char('0' + job.gerber);
+        inputs += char('0' + job.bom);
+        inputs += char('0' + int(job.manufacturer));
+        inputs += char('0' + job.drill);
+        inputs += char('0' + options.compressionLevel);
+        inputs += char('0' + options.reproducible);
+        inputs += char('0' + options.nativeDrill);
+        inputs += '\n';
+        for (auto &[name, value] : variables)
+            inputs += name + '=' + value + '\n';
+        if (pcbHashed)
+            key = hash64(inputs, pcbHash ^ CACHE_VERSION);
+    }
 
-    bool error = false;
-    for (auto &job : jobs) {
-        const char *manufacturers[] = {"Generic", "JLCPCB"};
-        std::cout << "*** " << job.name << " for " << manufacturers[int(job.manufacturer)] << " ***" << std::endl;
+    // skip the job if the inputs are the same as in the previous run and the outputs were not modified
+    if (key != 0 && !options.force) {
+        ProfileScope scope(profiler, "check cache", "io");
+        auto it = options.cache->find(job.name);
+        if (it != options.cache->end() && it->second.key == key) {
+            bool unchanged = true;
+            for (auto &[fileName, hash] : it->second.outputs) {
+                uint64_t h;
+                unchanged &= hashFile(outDir / fileName, h) && h == hash;
+            }
+            if (unchanged) {
+                log.out << "Unchanged, skipped" << std::endl;
+                log.skipped = true;
 
-        // try to read project (.kicad_pro) file for variables
-        std::map<std::string, std::string> variables;
-        {
-            fs::path projectPath = job.pcbPath;
-            projectPath.replace_extension(".kicad_pro");
-            std::ifstream is(projectPath.string());
-            if (is.is_open()) {
-                try {
-                    json j = json::parse(is);
-                    json vars = j.at("text_variables");
-                    for (auto it = vars.begin(); it != vars.end(); ++it) {
-                        std::string key = it.key();
-                        std::string value = it.value();
-                        variables[key] = value;
-                    }
-                } catch (std::exception &e) {
-                }
+                // in watch mode read the board anyway so that it is in memory when it changes
+                if (!options.watch)
+                    return;
             }
         }
+    }
 
-        // read pcb (.kicad_pcb) file
-        std::ifstream s(job.pcbPath.string());
-        if (!s) {
-            // error
-            std::cout << "Error: Can't read file " << job.pcbPath.string() << std::endl;
-            return 1;
+    // paths of all written files for the cache
+    std::vector<fs::path> outputs;
+
+    // read pcb (.kicad_pcb) file or its snapshot. In watch mode the board of the previous run is kept if the file is
+    // unchanged, otherwise the previous board stays alive until the footprints are extracted so that the footprints
+    // whose text did not change can be copied
+    kicad::FootprintTable previousFootprints;
+    bool reread = state.document == nullptr || !pcbHashed || state.pcbHash != pcbHash;
+    if (reread) {
+        state.previousDocument = std::move(state.document);
+        previousFootprints = std::move(state.footprints);
+        state.document = std::make_unique<kicad::Document>();
+        state.pcbHash = pcbHash;
+        state.footprints = {};
+    }
+    auto &document = *state.document;
+    bool read = true;
+    bool writeSnapshot = false;
+    fs::path snapshotPath = job.pcbPath;
+    snapshotPath += ".snapshot";
+    ProfileScope readScope(profiler, "read board", "io");
+    if (!reread) {
+        log.out << "Board unchanged" << std::endl;
+    } else if (options.snapshot && pcbHashed && kicad::readSnapshot(snapshotPath, document, pcbHash)) {
+        log.out << "Read snapshot " << snapshotPath.string() << std::endl;
+        read = true;
+        readScope.arg("snapshotBytes", getFileSize(snapshotPath));
+    } else if (stream) {
+        // single pass that only builds the containers accessed below, memory is bounded by the footprint count
+        std::ifstream s(job.pcbPath.string(), std::ios::binary);
+        read = bool(s);
+        if (read) {
+            kicad::Builder builder(document);
+            std::vector<kicad::Path> paths = {
+                {kicad::Atom::TITLE_BLOCK},
+                {kicad::Atom::LAYERS},
+                {kicad::Atom::SETUP, kicad::Atom::PCBPLOTPARAMS},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::AT},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::LAYER},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::PROPERTY},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::ATTR},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::PAD, kicad::Atom::AT},
+                {kicad::Atom::FOOTPRINT, kicad::Atom::PAD, kicad::Atom::DRILL}};
+            if (job.gerber && options.nativeDrill)
+                paths.push_back({kicad::Atom::VIA});
+            kicad::visitFile(s, builder, paths);
+            readScope.arg("bytesRead", getFileSize(job.pcbPath));
         }
-        kicad::Container file;
-        kicad::readFile(s, file);
-        s.close();
-
-        // get last write time of pcb
-        auto pcbTime = fs::last_write_time(job.pcbPath);
+    } else {
+        if (options.watch) {
+            // the board is kept for the next run, therefore read it into memory of the document instead of mapping
+            // it: pages of a mapped file that gets truncated and written in place change or become invalid (SIGBUS)
+            std::ifstream s(job.pcbPath, std::ios::binary);
+            read = bool(s);
+            if (read)
+                kicad::readFile(s, document, readOptions);
+        } else {
+            read = kicad::readFile(job.pcbPath, document, readOptions);
+        }
+        readScope.arg("bytesRead", getFileSize(job.pcbPath));
 
-        // get version suffix for file names
-        std::string version;
-        {
-            auto titleBlockContainer = file.find("title_block");
-            if (titleBlockContainer) {
-                auto revContainer = titleBlockContainer->find("rev");
-                if (revContainer) {
-                    version = '-';
-                    version += revContainer->getString(0);
-                    substituteVariables(version, variables);
-                }
+        // write a snapshot of the complete document for later runs when the footprints are known (streaming reads
+        // only a part of the document)
+        writeSnapshot = read && options.snapshot && pcbHashed;
+    }
+    readScope.end();
+    if (!read) {
+        // error
+        log.error() << "Can't read file " << job.pcbPath.string() << std::endl;
+        state.document.reset();
+        return;
+    }
+    auto &file = document.root;
+
+    // get last write time of pcb
+    auto pcbTime = fs::last_write_time(job.pcbPath);
+
+    // get version suffix for file names
+    std::string version;
+    {
+        auto titleBlockContainer = file.find(kicad::Atom::TITLE_BLOCK);
+        if (titleBlockContainer) {
+            auto revContainer = titleBlockContainer->find(kicad::Atom::REV);
+            if (revContainer) {
+                version = '-';
+                version += revContainer->getString(0);
+                substituteVariables(version, variables);
             }
         }
+    }
 
-        // zip gerber directory
-        if (job.gerber) {
+    // extract footprints once for all generators, copy unchanged footprints from the previous board
+    auto &footprints = state.footprints;
+    if (reread && (job.bom || job.drill || (job.gerber && options.nativeDrill))) {
+        ProfileScope scope(profiler, "footprints");
+        size_t copyCount = footprints.build(file, state.previousDocument ? &previousFootprints : nullptr);
+        scope.arg("footprints", int64_t(footprints.size()));
+        scope.arg("copied", int64_t(copyCount));
+        if (state.previousDocument) {
+            log.out << "Footprints: " << footprints.size() - copyCount << " of " << footprints.size() << " changed"
+                << std::endl;
+        }
+    }
+    if (writeSnapshot) {
+        ProfileScope scope(profiler, "write snapshot", "io");
+        if (!kicad::writeSnapshot(snapshotPath, file, pcbHash, footprints.textHashes))
+            log.out << "Warning: Could not write snapshot " << snapshotPath.string() << std::endl;
+        scope.arg("bytesWritten", getFileSize(snapshotPath));
+    }
 
-            // get layers
-            std::set<std::string> layers;
-            {
-                auto layerContainer = file.find("layers");
-                if (layerContainer) {
-                    for (auto layer : *layerContainer) {
-                        layers.insert(layer->getString(0));
-                    }
+    // inputs of the BOM/CPL and OpenSCAD drill files, they only get written if these changed since the previous run
+    // (e.g. not if only tracks or zones were edited in watch mode)
+    uint64_t footprintHash = footprints.getHash();
+    uint64_t bomKey = 0;
+    uint64_t drillKey = 0;
+    if (footprintHash != 0) {
+        bomKey = hash64(job.name + version + char('0' + int(job.manufacturer)), footprintHash);
+        drillKey = hash64(job.name, footprintHash);
+    }
+    std::vector<fs::path> bomPaths;
+    if (job.manufacturer == Manufacturer::GENERIC)
+        bomPaths = {outDir / (job.name + version + ".csv")};
+    else
+        bomPaths = {outDir / (job.name + version + "-BOM.csv"), outDir / (job.name + version + "-CPL.csv")};
+    fs::path scadPath = outDir / (job.name + ".scad");
+
+    // board is in memory now, the outputs of a skipped job are unchanged
+    if (log.skipped) {
+        state.bomKey = bomKey;
+        state.drillKey = drillKey;
+        return;
+    }
+    bool writeBom = job.bom;
+    if (writeBom && bomKey != 0 && bomKey == state.bomKey
+        && std::ranges::all_of(bomPaths, [](const fs::path &path) {return fs::exists(path);}))
+    {
+        log.out << "BOM unchanged" << std::endl;
+        outputs.insert(outputs.end(), bomPaths.begin(), bomPaths.end());
+        writeBom = false;
+    }
+    bool writeDrill = job.drill;
+    if (writeDrill && drillKey != 0 && drillKey == state.drillKey && fs::exists(scadPath)) {
+        log.out << "OpenSCAD drill unchanged" << std::endl;
+        outputs.push_back(scadPath);
+        writeDrill = false;
+    }
+
+    // zip gerber directory
+    if (job.gerber) {
+
+        // get layers
+        std::set<std::string> layers;
+        {
+            auto layerContainer = file.find(kicad::Atom::LAYERS);
+            if (layerContainer) {
+                for (auto layer : *layerContainer) {
+                    layers.insert(layer->getString(0));
                 }
             }
+        }
 
-            // get gerber directory from pcb file (configured in the plot dialog)
-            auto setup = file.find("setup");
-            if (setup != nullptr) {
-                auto plotParams = setup->find("pcbplotparams");
-                if (plotParams != nullptr) {
-                    // get gerber directory
-                    auto gerberDir = fs::weakly_canonical(job.pcbPath.parent_path() / plotParams->findString("outputdirectory"));
-                    if (fs::is_directory(gerberDir)) {
-                        // get selected layers
-                        auto selection = plotParams->findString("layerselection");
-                        std::string selectedLayers;
-                        uint32_t flags[4] = {};
-                        int index = 0;
-                        int length = selection.size();
-                        for (int i = 2; i < length; ++i) {
-                            char ch = selection[i];
-
-                            // check for next filed
-                            if (ch == '_') {
-                                ++index;
-                                if (index == 4)
-                                    break;
-                            }
-
-                            int nibble = ch <= '9' ? ch - '0' : (ch - 'a' + 10);
-                            flags[index] = (flags[index] << 4) | nibble;
+        // get gerber directory from pcb file (configured in the plot dialog)
+        auto setup = file.find(kicad::Atom::SETUP);
+        if (setup != nullptr) {
+            auto plotParams = setup->find(kicad::Atom::PCBPLOTPARAMS);
+            if (plotParams != nullptr) {
+                // get gerber directory
+                auto gerberDir = fs::weakly_canonical(job.pcbPath.parent_path() / plotParams->findString(kicad::Atom::OUTPUTDIRECTORY));
+                if (fs::is_directory(gerberDir)) {
+                    // get selected layers
+                    ProfileScope layerScope(profiler, "layer selection");
+                    auto selection = plotParams->findString(kicad::Atom::LAYERSELECTION);
+                    std::string selectedLayers;
+                    uint32_t flags[4] = {};
+                    int index = 0;
+                    int length = selection.size();
+                    for (int i = 2; i < length; ++i) {
+                        char ch = selection[i];
+
+                        // check for next filed
+                        if (ch == '_') {
+                            ++index;
+                            if (index == 4)
+                                break;
                         }
 
-                        if (index <= 2) {
-                            // old format (KiCad 8)
-                            static const char *layerNames[] = {
-                                "F.Adhesive", "B.Adhesive", "F.Paste", "B.Paste",
-                                "F.Silkscreen", "B.Silkscreen", "F.Mask", "B.Mask",
-                                "User.Drawings", "User.Comments", "User.Eco1", "User.Eco2",
-                                "Edge.Cuts", "Margin", "F.Courtyard", "B.Courtyard",
-                                "F.Fab", "B.Fab", "User.1", "User.2",
-                                "User.3", "User.4", "User.5", "User.6",
-                                "User.7", "User.8", "User.9"
-                            };
-
-                            // copper layers
-                            if ((flags[1] & 1) != 0 && layers.contains("F.Cu"))
-                                selectedLayers += "F.Cu,";
-                            for (int i = 1; i < 31; ++i) {
-                                if ((flags[1] >> i) & 1) {
-                                    std::string layer = "In" + std::to_string(i) + ".Cu";
-                                    if (layers.contains(layer)) {
-                                        selectedLayers += layer;
-                                        selectedLayers += ',';
-                                    }
+                        int nibble = ch <= '9' ? ch - '0' : (ch - 'a' + 10);
+                        flags[index] = (flags[index] << 4) | nibble;
+                    }
+
+                    if (index <= 2) {
+                        // old format (KiCad 8)
+                        static const char *layerNames[] = {
+                            "F.Adhesive", "B.Adhesive", "F.Paste", "B.Paste",
+                            "F.Silkscreen", "B.Silkscreen", "F.Mask", "B.Mask",
+                            "User.Drawings", "User.Comments", "User.Eco1", "User.Eco2",
+                            "Edge.Cuts", "Margin", "F.Courtyard", "B.Courtyard",
+                            "F.Fab", "B.Fab", "User.1", "User.2",
+                            "User.3", "User.4", "User.5", "User.6",
+                            "User.7", "User.8", "User.9"
+                        };
+
+                        // copper layers
+                        if ((flags[1] & 1) != 0 && layers.contains("F.Cu"))
+                            selectedLayers += "F.Cu,";
+                        for (int i = 1; i < 31; ++i) {
+                            if ((flags[1] >> i) & 1) {
+                                std::string layer = "In" + std::to_string(i) + ".Cu";
+                                if (layers.contains(layer)) {
+                                    selectedLayers += layer;
+                                    selectedLayers += ',';
                                 }
                             }
-                            if ((flags[1] & 0x80000000) && layers.contains("B.Cu"))
-                                selectedLayers += "B.Cu,";
-
-                            // other layers
-                            for (int i = 0; i < 27; ++i) {
-                                if ((flags[0] >> i) & 1) {
-                                        //if (layers.contains(layerNames[i])) {
-                                            selectedLayers += layerNames[i];
-                                            selectedLayers += ',';
-                                        //}
-                                    }
-                            }
-                        } else {
-                            // new format (KiCad 9)
-                            static const char *layerNames[] = {
-                                "F.Mask",
-                                "B.Mask",
-                                "F.Silkscreen",
-                                "B.Silkscreen",
-                                "F.Adhesive",
-                                "B.Adhesive",
-                                "F.Paste",
-                                "B.Paste",
-                                "User.Drawings",
-                                "User.Comments",
-                                "User.Eco1",
-                                "User.Eco2",
-                                "Edge.Cuts",
-                                "Margin",
-                                "F.Courtyard",
-                                "B.Courtyard",
-                                "F.Fab",
-                                "B.Fab",
-                                "",
-                                "User.1",
-                                "User.2",
-                                "User.3",
-                                "User.4",
-                                "User.5",
-                                "User.6",
-                                "User.7",
-                                "User.8",
-                                "User.9"
-                            };
-
-                            // copper layers (... x In3.Cu x In2.Cu x In1.Cu x B.Cu x F.Cu)
-                            if ((flags[3] & 1) != 0 && layers.contains("F.Cu"))
-                                selectedLayers += "F.Cu,";
-                            for (int i = 2; i < 32; ++i) {
-                                if ((flags[3 - i / 16] >> (i * 2 & 31)) & 1) {
-                                    std::string layer = "In" + std::to_string(i - 1) + ".Cu";
-                                    if (layers.contains(layer)) {
-                                        selectedLayers += layer;
+                        }
+                        if ((flags[1] & 0x80000000) && layers.contains("B.Cu"))
+                            selectedLayers += "B.Cu,";
+
+                        // other layers
+                        for (int i = 0; i < 27; ++i) {
+                            if ((flags[0] >> i) & 1) {
+                                    //if (layers.contains(layerNames[i])) {
+                                        selectedLayers += layerNames[i];
                                         selectedLayers += ',';
-                                    }
+                                    //}
                                 }
-                            }
-                            if ((flags[3] & 4) && layers.contains("B.Cu"))
-                                selectedLayers += "B.Cu,";
-
-                            // other layers
-                            for (int i = 0; i < 28; ++i) {
-                                if ((flags[3 - i / 16] >> (i * 2 & 31)) & 2) {
-                                    selectedLayers += layerNames[i];
+                        }
+                    } else {
+                        // new format (KiCad 9)
+                        static const char *layerNames[] = {
+                            "F.Mask",
+                            "B.Mask",
+                            "F.Silkscreen",
+                            "B.Silkscreen",
+                            "F.Adhesive",
+                            "B.Adhesive",
+                            "F.Paste",
+                            "B.Paste",
+                            "User.Drawings",
+                            "User.Comments",
+                            "User.Eco1",
+                            "User.Eco2",
+                            "Edge.Cuts",
+                            "Margin",
+                            "F.Courtyard",
+                            "B.Courtyard",
+                            "F.Fab",
+                            "B.Fab",
+                            "",
+                            "User.1",
+                            "User.2",
+                            "User.3",
+                            "User.4",
+                            "User.5",
+                            "User.6",
+                            "User.7",
+                            "User.8",
+                            "User.9"
+                        };
+
+                        // copper layers (... x In3.Cu x In2.Cu x In1.Cu x B.Cu x F.Cu)
+                        if ((flags[3] & 1) != 0 && layers.contains("F.Cu"))
+                            selectedLayers += "F.Cu,";
+                        for (int i = 2; i < 32; ++i) {
+                            if ((flags[3 - i / 16] >> (i * 2 & 31)) & 1) {
+                                std::string layer = "In" + std::to_string(i - 1) + ".Cu";
+                                if (layers.contains(layer)) {
+                                    selectedLayers += layer;
                                     selectedLayers += ',';
-                                        //std::cout << i << std::endl;
-                                    //}
                                 }
                             }
                         }
-
-                        // remove trailing ','
-                        if (!selectedLayers.empty())
-                            selectedLayers.resize(selectedLayers.size() - 1);
-
-                        // export gerber
-                        {
-                            std::cout << "Export gerber" << std::endl;
-                            // add --check-zones
-                            std::string command = "kicad-cli pcb export gerbers -l " + selectedLayers + " --subtract-soldermask --output " + gerberDir.string() + ' ' + job.pcbPath.string();
-                            int result = std::system(command.c_str());
-                            if (result != 0) {
-                                error = true;
-                                std::cerr << "Error: Gerber export, kicad-cli returned result " << result << std::endl;
+                        if ((flags[3] & 4) && layers.contains("B.Cu"))
+                            selectedLayers += "B.Cu,";
+
+                        // other layers
+                        for (int i = 0; i < 28; ++i) {
+                            if ((flags[3 - i / 16] >> (i * 2 & 31)) & 2) {
+                                selectedLayers += layerNames[i];
+                                selectedLayers += ',';
+                                    //log.out << i << std::endl;
+                                //}
                             }
                         }
+                    }
 
-                        // export drill
-                        {
-                            std::cout << "Export drill" << std::endl;
-                            std::string command = "kicad-cli pcb export drill --excellon-separate-th";
+                    // remove trailing ','
+                    if (!selectedLayers.empty())
+                        selectedLayers.resize(selectedLayers.size() - 1);
+                    layerScope.end();
+
+                    // export gerber and drill concurrently
+                    {
+                        log.out << "Export gerber and drill" << std::endl;
+                        ProfileScope exportScope(profiler, "export gerber and drill");
+                        // add --check-zones
+                        std::vector<std::string> gerberCommand = {"kicad-cli", "pcb", "export", "gerbers",
+                            "-l", selectedLayers, "--subtract-soldermask", "--output", gerberDir.string(),
+                            job.pcbPath.string()};
+                        auto gerberResult = std::async(std::launch::async, runProfiledProcess, profiler,
+                            "kicad-cli gerbers", gerberCommand);
+
+                        if (options.nativeDrill) {
+                            // write Excellon files from the parsed board while kicad-cli exports the gerber
+                            ProfileScope scope(profiler, "write drill", "io");
+                            int skippedViaCount;
+                            auto holes = kicad::getDrillHoles(footprints, file, skippedViaCount);
+                            if (skippedViaCount > 0) {
+                                log.out << "Warning: " << skippedViaCount
+                                    << " blind or micro vias are not supported by the drill export" << std::endl;
+                            }
+                            int copperLayerCount = std::ranges::count_if(layers, [](const std::string &layer) {
+                                return layer.ends_with(".Cu");
+                            });
+                            auto ovalFormat = job.manufacturer == Manufacturer::JLCPCB
+                                ? kicad::OvalFormat::ALTERNATE : kicad::OvalFormat::ROUTE;
+                            auto boardName = job.pcbPath.stem().string();
+                            for (bool plated : {true, false}) {
+                                auto drillPath = gerberDir / (boardName + (plated ? "-PTH.drl" : "-NPTH.drl"));
+                                if (!kicad::writeExcellon(drillPath, holes, plated, copperLayerCount, ovalFormat)) {
+                                    log.error() << "Could not write drill file: " << drillPath.string() << std::endl;
+                                }
+                                scope.arg(plated ? "bytesWrittenPTH" : "bytesWrittenNPTH", getFileSize(drillPath));
+
+                                // no drill map gets written, remove the map of an earlier kicad-cli export so that it
+                                // does not end up in the zip next to drill files it does not match
+                                auto mapPath = gerberDir / (boardName + (plated ? "-PTH" : "-NPTH") + "-drl_map.gbr");
+                                std::error_code ec;
+                                if (fs::remove(mapPath, ec)) {
+                                    log.out << "Removed drill map " << mapPath.string()
+                                        << " of kicad-cli, native drill export writes no map" << std::endl;
+                                }
+                            }
+                            scope.arg("holes", int64_t(holes.size()));
+                        } else {
+                            std::vector<std::string> drillCommand = {"kicad-cli", "pcb", "export", "drill",
+                                "--excellon-separate-th"};
                             if (job.manufacturer == Manufacturer::JLCPCB)
-                                command += " --excellon-oval-format";
-                            command += " --generate-map --map-format gerberx2 --output " + gerberDir.string() + ' ' + job.pcbPath.string();
-                            int result = std::system(command.c_str());
-                            if (result != 0) {
-                                error = true;
-                                std::cerr << "Error: Drill export, kicad-cli returned result " << result << std::endl;
+                                drillCommand.push_back("--excellon-oval-format");
+                            drillCommand.insert(drillCommand.end(), {"--generate-map", "--map-format", "gerberx2",
+                                "--output", gerberDir.string(), job.pcbPath.string()});
+                            auto drill = runProfiledProcess(profiler, "kicad-cli drill", drillCommand);
+                            log.out << drill.output;
+                            if (drill.exitCode != 0) {
+                                log.error() << "Drill export, kicad-cli returned result " << drill.exitCode << std::endl;
                             }
                         }
 
-                        // zip gerber
-                        std::cout << "Zip gerber" << std::endl;
-                        auto zipPath = outDir / (job.name + version + ".zip");
-
-                        // create new zip
-                        ZipArchive zip(zipPath.string());
-                        if (zip.open(ZipArchive::New)) {
-                            // add files
-                            fs::directory_iterator end;
-                            for (fs::directory_iterator it(gerberDir); it != end; ++it) {
-                                if (it->is_regular_file()) {
-                                    // read file
-                                    fs::path path = it->path();
-
-                                    // check last write time
-                                    if (fs::last_write_time(path) < pcbTime) {
-                                        std::cerr << "Error: File is not up-to-date: " << path.string() << std::endl;
-                                        error = true;
-                                    }
-
-                                    if (!zip.addFile(path.filename().string(), path.string())) {
-                                        std::cerr << "Error: Could add file to zip" << std::endl;
-                                        error = true;
-                                    }
-                                }
+                        auto gerber = gerberResult.get();
+                        log.out << gerber.output;
+                        if (gerber.exitCode != 0) {
+                            log.error() << "Gerber export, kicad-cli returned result " << gerber.exitCode << std::endl;
+                        }
+                    }
+
+                    // zip gerber
+                    log.out << "Zip gerber" << std::endl;
+                    ProfileScope zipScope(profiler, "zip gerber", "io");
+                    auto zipPath = outDir / (job.name + version + ".zip");
+
+                    // create new zip, files get compressed in parallel while they are added
+                    ZipWriter zip(options.compressionLevel, readOptions.threadCount);
+                    if (zip.open(zipPath)) {
+                        // collect files sorted by name, the order of the directory iterator is unspecified
+                        std::vector<fs::directory_entry> files;
+                        fs::directory_iterator end;
+                        for (fs::directory_iterator it(gerberDir); it != end; ++it) {
+                            if (it->is_regular_file())
+                                files.push_back(*it);
+                        }
+                        std::ranges::sort(files, {}, [](const fs::directory_entry &e) {return e.path().filename();});
+
+                        // add files
+                        for (auto &file : files) {
+                            fs::path path = file.path();
+
+                            // check last write time
+                            auto time = file.last_write_time();
+                            if (time < pcbTime) {
+                                log.error() << "File is not up-to-date: " << path.string() << std::endl;
                             }
-                            zip.close();
+
+                            // reproducible archives use a fixed time
+                            std::optional<fs::file_time_type> zipTime;
+                            if (!options.reproducible)
+                                zipTime = time;
+                            if (!zip.addFile(path.filename().string(), path, zipTime)) {
+                                log.error() << "Could not add file to zip: " << path.string() << std::endl;
+                            }
+                        }
+                        if (zip.close()) {
+                            outputs.push_back(zipPath);
                         } else {
-                            std::cerr << "Error: Could not write zip file: " << zipPath.string() << std::endl;
-                            error = true;
+                            log.error() << "Could not write zip file: " << zipPath.string() << std::endl;
+                        }
+                        int64_t bytesRead = 0;
+                        for (auto &entry : zip.getEntries())
+                            bytesRead += int64_t(entry.size);
+                        zipScope.arg("files", int64_t(zip.getEntries().size()));
+                        zipScope.arg("bytesRead", bytesRead);
+                        zipScope.arg("bytesWritten", getFileSize(zipPath));
+
+                        if (options.verbose) {
+                            for (auto &entry : zip.getEntries()) {
+                                auto us = std::chrono::duration_cast<std::chrono::microseconds>(entry.time);
+                                log.out << "  " << entry.name << ": " << entry.size << " -> " << entry.compressedSize
+                                    << " bytes, " << us.count() << " us" << std::endl;
+                            }
                         }
                     } else {
-                        std::cerr << "Error: Gerber directory not found: " << gerberDir.string() << std::endl;
-                        error = true;
+                        log.error() << "Could not write zip file: " << zipPath.string() << std::endl;
                     }
                 } else {
-                    std::cerr << "Error: Gerber directory configuration not found" << std::endl;
-                    error = true;
+                    log.error() << "Gerber directory not found: " << gerberDir.string() << std::endl;
                 }
             } else {
-                std::cerr << "Error: Gerber directory configuration not found" << std::endl;
-                error = true;
+                log.error() << "Gerber directory configuration not found" << std::endl;
             }
+        } else {
+            log.error() << "Gerber directory configuration not found" << std::endl;
         }
+    }
 
-        if (job.bom && manufacturer == Manufacturer::GENERIC) {
-            // open generic BOM file
-            fs::path bomPath = outDir / (job.name + version + ".csv");
-            std::ofstream bom(bomPath);
-            if (bom.is_open()) {
-                std::map<BomKey, BomValue> bomMap;
-
-                //bom << "Count,Type,Value,Voltage,Footprint,SMD Pads,THT Pads,Manufacturer,MPN,Description" << std::endl;
-                bom << "Count,Reference,Value,Voltage,Footprint,SMD Pads,THT Pads,Manufacturer,MPN,Description" << std::endl;
-
-                for (auto element1 : file.elements) {
-                    auto container1 = dynamic_cast<kicad::Container *>(element1);
-                    if (container1) {
-                        // check if it is a footprint
-                        if (container1->id == "footprint") {
-                            auto footprint = container1;
-
-                            // get footprint name
-                            auto footprintName = footprint->getString(0);
-
-                            // remove library from footprint name
-                            auto pos = footprintName.find(':');
-                            if (pos != std::string::npos)
-                                footprintName.erase(0, pos + 1);
-
-                            // get footprint properties
-                            //std::string type; // e.g. "R" or "C"
-                            std::string reference; // e.g. "R1"
-                            std::string value; // e.g. 100k
-                            int voltage = 0;
-                            //int padCount = 0;
-                            std::set<std::string> padNames; // to detect duplicates
-                            std::string manufacturer;
-                            std::string mpn;
-                            std::string description;
-                            bool doNotPopulate = false;
-                            bool excludeFromBom = false;
-                            bool throughHole = false;
-                            for (auto element2 : container1->elements) {
-                                auto property = dynamic_cast<kicad::Container *>(element2);
-                                if (property) {
-                                    if (property->id == "property") {
-                                        auto propertyName = property->getString(0);
-                                        auto propertyValue = property->getString(1);
-                                        if (propertyName == "Reference") {
-                                            // reference, e.g. "R1"
-                                            reference = propertyValue;
-                                        } else if (propertyName == "Value") {
-                                            // value, e.g. "100k"
-                                            value = propertyValue;
-                                        } else if (propertyName == "Voltage") {
-                                            // operating voltage
-                                            voltage = lround(std::stod(propertyValue) * 1000.0);
-                                        } else if (propertyName == "Manufacturer") {
-                                            manufacturer = propertyValue;
-                                        } else if (propertyName == "MPN") {
-                                            // manufacturer part number
-                                            mpn = propertyValue;
-                                        } else if (propertyName == "Description") {
-                                            description = propertyValue;
-                                        }
-                                    }
-                                    if (property->id == "attr") {
-                                        doNotPopulate = property->contains("dnp");
-                                        excludeFromBom = property->contains("exclude_from_bom");
-                                        throughHole = property->contains("through_hole");
-                                    }
-                                    if (property->id == "pad") {
-                                        auto padName = property->getString(0);
-                                        padNames.insert(padName);
-                                        //++padCount;
-                                    }
-                                }
-                            }
+    int errorCount = log.errorCount;
+    if (writeBom && job.manufacturer == Manufacturer::GENERIC) {
+        // open generic BOM file
+        ProfileScope scope(profiler, "write BOM", "io");
+        fs::path bomPath = bomPaths[0];
+        std::ofstream bom(bomPath);
+        if (bom.is_open()) {
+            // parts grouped by properties (e.g. value and footprint)
+            std::vector<uint32_t> invalidVoltages;
+            auto groups = kicad::groupBom(footprints, kicad::BomFormat::GENERIC, &invalidVoltages);
+            for (auto i : invalidVoltages) {
+                log.out << "Warning: Invalid voltage " << footprints.getProperty(i, "Voltage") << " of "
+                    << footprints.references[i] << std::endl;
+            }
 
-                            if (!excludeFromBom) {
-                                auto &v = bomMap[{getType(reference), value, voltage, footprintName, manufacturer, mpn}];
-                                v.references.push_back(reference);
-                                int padCount = padNames.size();
-                                v.padCount = std::max(v.padCount, padCount);
-                                v.throughHole = throughHole;
-                                v.description = description;
-                            }
-                        }
-                    }
+            //bom << "Count,Type,Value,Voltage,Footprint,SMD Pads,THT Pads,Manufacturer,MPN,Description" << std::endl;
+            bom << "Count,Reference,Value,Voltage,Footprint,SMD Pads,THT Pads,Manufacturer,MPN,Description" << std::endl;
+
+            // write BOM
+            for (auto &group : groups) {
+                // pad count of the part with most pads, pads with the same name are connected. Through hole and
+                // description are taken from the last part
+                int padCount = 0;
+                bool throughHole = false;
+                std::string_view description;
+                for (auto i : group.parts) {
+                    std::set<std::string_view> padNames(footprints.padNames.begin() + footprints.padBegin[i],
+                        footprints.padNames.begin() + footprints.padBegin[i + 1]);
+                    padCount = std::max(padCount, int(padNames.size()));
+                    throughHole = footprints.has(i, kicad::FootprintTable::THROUGH_HOLE);
+                    description = footprints.getProperty(i, "Description");
                 }
 
-                // write BOM
-                for (auto &p : bomMap) {
-                    // count
-                    bom << p.second.references.size() << ",";
+                // count
+                bom << group.parts.size() << ",";
 
-                    // type
-                    //bom << p.first.type << ",";
+                // type
+                //bom << group.type << ",";
 
-                    // references
-                    bom << '"';
-                    for (auto &reference : p.second.references) {
-                        if (reference != p.second.references.front())
-                            bom << ',';
-                        bom << reference;
-                    }
-                    bom << "\",";
+                // references in natural order, compressed to ranges (e.g. R1-R8)
+                bom << '"' << kicad::compressDesignators(group.designators) << "\",";
 
-                    // value, voltage, footprint
-                    bom << "\"" << p.first.value << "\","
-                        << (p.first.voltage * 0.001) << ","
-                        << p.first.footprint << ",";
+                // value, voltage, footprint
+                bom << "\"" << group.value << "\","
+                    << (group.voltage * 0.001) << ","
+                    << group.footprint << ",";
 
-                    // pad count
-                    if (p.second.throughHole)
-                        bom << ',';
-                    bom << p.second.padCount << ",";
-                    if (!p.second.throughHole)
-                        bom << ',';
+                // pad count
+                if (throughHole)
+                    bom << ',';
+                bom << padCount << ",";
+                if (!throughHole)
+                    bom << ',';
 
-                    // manufactuer, part number, description
-                    bom << "\"" << p.first.manufacturer << "\","
-                        << p.first.mpn << ","
-                        "\"" << p.second.description << "\"" << std::endl;
-                }
-                bom.close();
-            } else {
-                std::cout << "Error: Could not create BOM file in " << outDir.string() << std::endl;
-                error = true;
+                // manufactuer, part number, description
+                bom << "\"" << group.manufacturer << "\","
+                    << group.mpn << ","
+                    "\"" << description << "\"" << std::endl;
             }
+            bom.close();
+            outputs.push_back(bomPath);
+            scope.arg("bytesWritten", getFileSize(bomPath));
+        } else {
+            log.error() << "Could not create BOM file in " << outDir.string() << std::endl;
         }
+    }
 
-        if (job.bom && manufacturer == Manufacturer::JLCPCB) {
-            // open BOM file for JLCPCB
-            fs::path bomPath = outDir / (job.name + version + "-BOM.csv");
-            std::ofstream bom(bomPath);
-
-            // open CPL file
-            fs::path cplPath = outDir / (job.name + version + "-CPL.csv");
-            std::ofstream cpl(cplPath);
-
-            if (bom.is_open() && cpl.is_open()) {
-                // map from part protperties (e.g. footprint) to list of references (e.g. R1, R2, R3...)
-                std::map<JlcBomKey, std::vector<std::string>> bomMap;
-
-                // set of used references to detect duplicates
-                std::set<std::string> usedReferences;
-
-                bom << "Comment,Designator,Footprint,LCSC PN" << std::endl;
-                cpl << "Designator,Mid X,Mid Y,Rotation,Layer" << std::endl;
-                for (auto element1 : file.elements) {
-                    auto container1 = dynamic_cast<kicad::Container *>(element1);
-                    if (container1) {
-                        // check if it is a footprint
-                        if (container1->id == "footprint") {
-                            auto footprint = container1;
-
-                            // get footprint name
-                            auto footprintName = footprint->getString(0);
-                            //std::cout << "Footprint: " << footprintName << std::endl;
-
-                            // remove library from footprint name
-                            auto pos = footprintName.find(':');
-                            if (pos != std::string::npos)
-                                footprintName.erase(0, pos + 1);
-
-                            // get layer
-                            auto layer = footprint->findString("layer");
-
-                            // get footprint properties
-                            std::string x, y, rot;
-                            std::string reference;
-                            std::string value;
-                            std::string lcscPn;
-                            bool doNotPopulate = false;
-                            bool excludeFromBom = false;
-                            for (auto element2 : container1->elements) {
-                                auto property = dynamic_cast<kicad::Container *>(element2);
-                                if (property) {
-                                    if (property->id == "at") {
-                                        x = property->getString(0);
-                                        y = property->getString(1);
-                                        rot = property->getString(2, "0");
-                                    }
-                                    if (property->id == "property") {
-                                        auto propertyName = property->getString(0);
-                                        auto propertyValue = property->getString(1);
-                                        if (propertyName == "Reference") {
-                                            // reference (designator), e.g. "R1"
-                                            reference = propertyValue;
-                                        } else if (propertyName == "Value") {
-                                            // value, e.g. "100k"
-                                            value = propertyValue;
-                                        } else if (propertyName == "LCSC PN") {
-                                            // LCSC part number
-                                            lcscPn = propertyValue;
-                                        }
-                                    }
-                                    if (property->id == "attr") {
-                                        doNotPopulate = property->contains("dnp");
-                                        excludeFromBom = property->contains("exclude_from_bom");
-                                    }
-                                }
-                            }
+    if (writeBom && job.manufacturer == Manufacturer::JLCPCB) {
+        // open BOM file for JLCPCB
+        ProfileScope scope(profiler, "write BOM and CPL", "io");
+        fs::path bomPath = bomPaths[0];
+        std::ofstream bom(bomPath);
+
+        // open CPL file
+        fs::path cplPath = bomPaths[1];
+        std::ofstream cpl(cplPath);
+
+        if (bom.is_open() && cpl.is_open()) {
+            // set of used references to detect duplicates
+            std::set<std::string_view> usedReferences;
+
+            bom << "Comment,Designator,Footprint,LCSC PN" << std::endl;
+            cpl << "Designator,Mid X,Mid Y,Rotation,Layer" << std::endl;
+            for (size_t i = 0; i < footprints.size(); ++i) {
+                if (footprints.has(i, kicad::FootprintTable::DNP)
+                    || footprints.has(i, kicad::FootprintTable::EXCLUDE_FROM_BOM))
+                {
+                    continue;
+                }
+                auto reference = footprints.references[i];
 
-                            if (!doNotPopulate && !excludeFromBom) {
-                                // check for duplicate reference
-                                if (usedReferences.contains(reference)) {
-                                    std::cout << "Error: Duplicate reference " << reference << std::endl;
-                                    error = true;
-                                }
-                                usedReferences.insert(reference);
+                // check for duplicate reference
+                if (!usedReferences.insert(reference).second) {
+                    log.error() << "Duplicate reference " << reference << std::endl;
+                }
 
-                                //std::cout << "add " << footprint << " reference " << reference << " value " << value << " at " << x << ' ' << y << ' ' << rot << std::endl;
+                std::string side = footprints.layers[i] == "F.Cu" ? "top" : "bottom";
 
-                                bomMap[{getType(reference), value, footprintName, lcscPn}].push_back(reference);
+                // write line to CPL file (y-axis points up)
+                cpl << reference << ',' << formatNumber(footprints.positionX[i]) << ','
+                    << formatNumber(-footprints.positionY[i]) << ',' << formatNumber(footprints.rotations[i]) << ","
+                    << side << std::endl;
+            }
+            cpl.close();
+            outputs.push_back(cplPath);
+
+            // parts grouped by properties (e.g. footprint) with list of references (e.g. R1, R2, R3...)
+            auto groups = kicad::groupBom(footprints, kicad::BomFormat::JLCPCB);
+
+            // write BOM
+            log.out << "Write BOM" << std::endl;
+            for (auto &group : groups) {
+                // comment (use value)
+                bom << group.value;
+
+                // quoted list of references in natural order (not compressed to ranges, JLCPCB matches each
+                // designator with the CPL file)
+                bom << ",\"";
+                bool first = true;
+                for (auto &designator : group.designators) {
+                    if (!first)
+                        bom << ',';
+                    first = false;
+                    bom << designator.designator;
+                }
+                bom << "\",";
 
-                                std::string side = layer == "F.Cu" ? "top" : "bottom";
+                // footprint and LCSC PN
+                bom << group.footprint << ',' << group.lcscPn << std::endl;
+            }
+            bom.close();
+            outputs.push_back(bomPath);
+            scope.arg("bytesWritten", getFileSize(bomPath) + getFileSize(cplPath));
+        } else {
+            log.error() << "Could not create BOM/CPL file in " << outDir.string() << std::endl;
+        }
+    }
 
-                                // write line to CPL file
-                                cpl << reference << ',' << x << ",-" << y << ',' << rot << "," << side << std::endl;
-                            } else {
-                                //std::cout << "reject " << footprint << " reference " << reference << " value " << value << std::endl;
-                            }
-                        }
-                    }
-                }
-                cpl.close();
-
-                // print BOM to std::cout
-                /*for (auto &p : bomMap) {
-                    int count = p.second.size();
-                    std::cout << count << "x " << p.first.value << " (" << p.first.footprintName << ')';
-                    for (auto &reference : p.second) std::cout << " " << reference;
-                    std::cout << std::endl;
-                }*/
-
-                // write BOM
-                std::cout << "Write BOM" << std::endl;
-                for (auto &p : bomMap) {
-                    // comment (use value)
-                    bom << p.first.value;
-
-                    // quoted list of references
-                    bom << ",\"";
-                    bool first = true;
-                    std::ranges::sort(p.second);
-                    for (auto &reference : p.second) {
-                        if (!first)
-                            bom << ',';
+    if (writeBom)
+        state.bomKey = log.errorCount == errorCount ? bomKey : 0;
+
+    if (writeDrill) {
+        // open drill file for OpenSCAD export
+        ProfileScope scope(profiler, "write OpenSCAD drill", "io");
+        fs::path drillPath = scadPath;
+        std::ofstream drillFile(drillPath);
+
+        for (size_t i = 0; i < footprints.size(); ++i) {
+            // get position and rotation of footprint
+            double2 position = {footprints.positionX[i], footprints.positionY[i]};
+            double rotation = footprints.rotations[i];
+            double r = rotation * pi / 180.0;
+            double s = sin(r);
+            double c = cos(r);
+
+            // get drill holes
+            bool first = true;
+            for (uint32_t pad = footprints.padBegin[i]; pad < footprints.padBegin[i + 1]; ++pad) {
+                auto type = footprints.padTypes[pad];
+                if (type == "thru_hole" || type == "np_thru_hole") {
+                    // pad position and drill size
+                    double x = footprints.padX[pad];
+                    double y = footprints.padY[pad];
+                    double w = footprints.drillWidths[pad];
+                    double h = footprints.drillHeights[pad];
+
+                    // transform to global coordinates
+                    double gX = position.x + c * x + s * y;
+                    double gY = position.y + c * y - s * x;
+
+                    if (first) {
                         first = false;
-                        bom << reference;
+                        drillFile << "// " << footprints.footprints[i] << std::endl;
                     }
-                    bom << "\",";
-
-                    // footprint and LCSC PN
-                    bom <<  p.first.footprintName << ',' << p.first.lcscPn << std::endl;
+                    drillFile << "drill(" << gX << ", " << gY << ", " << w << ", " << h << ", " << rotation << ");";
+                    auto padName = footprints.padNames[pad];
+                    if (!padName.empty())
+                        drillFile << " // " << padName;
+                    drillFile << std::endl;
                 }
-                bom.close();
+            }
+            if (!first)
+                drillFile << std::endl;
+        }
+        drillFile.close();
+        outputs.push_back(drillPath);
+        scope.arg("bytesWritten", getFileSize(drillPath));
+        state.drillKey = drillKey;
+    }
+
+    // memory statistics of the document after all generators accessed it, the peak of the arenas is the memory of
+    // this job
+    if (options.stats)
+        kicad::printStats(log.out, kicad::getStats(document));
+
+    // new cache entry with the hashes of the written files
+    if (key != 0 && log.errorCount == 0) {
+        ProfileScope scope(profiler, "hash outputs", "io");
+        log.cacheEntry.key = key;
+        for (auto &path : outputs) {
+            uint64_t hash;
+            if (hashFile(path, hash))
+                log.cacheEntry.outputs[path.filename().string()] = hash;
+        }
+    }
+}
+
+
+/// @brief BOM Tool: Zip gerber files and create BOM and CPL files
+///
+/// Usage:
+/// bom-tool <options> <path to .kicad_pcb file> <output directory>
+/// Options:
+///   -n Name for output files (optional, derived from .kicad_pcb file name if not given)
+///   -g Export and zip gerber files (path to gerber and layers are read from the .kicad_pcb file)
+///   -b Generate BOM and placement file
+///   -j Generate for JLCPCB (oval holes alternate, BOM with LCSC PN, CPL)
+///   -t Number of threads for parsing .kicad_pcb files and compressing zip files (optional, default is number of cores)
+///   --no-lazy Parse .kicad_pcb files completely instead of parsing footprints and other top level elements on first
+///     access (e.g. for debugging or comparing output, use with -t 1 for serial parsing)
+///   -s Stream .kicad_pcb files and keep only footprints and settings in memory (optional, for very large boards)
+///   -J Number of jobs to run in parallel (optional, default is 1, 0 is number of cores)
+///   -z Compression level for zip files from 1 (fastest) to 9 (best), 0 to store (optional, default is 6)
+///   -r Reproducible zip files with fixed timestamps, identical gerber files result in identical zip files
+///   -e Write Excellon drill files directly instead of using kicad-cli (faster, but no drill map gets written and
+///     drill maps of earlier kicad-cli exports get removed from the gerber directory)
+///   --snapshot Read the board from a binary snapshot (.kicad_pcb.snapshot) that gets created on the first run
+///   -v Verbose output, e.g. size and compression time of each file in the zip
+///   --stats Print memory statistics of each job (node counts by container id, tree heap and its peak) and the peak
+///     memory of the process since its start after all jobs
+///   --profile <file> Write the timing of all phases, jobs and subprocesses to a Chrome trace event file
+///   -f Force processing of all jobs (optional, default is to skip jobs whose inputs and outputs are unchanged)
+///   --watch Keep running and process the jobs again when their .kicad_pcb or .kicad_pro file changes
+///
+/// Multiple pcb files can be processed in one go. The exit status is 1 if any job reported an error (the other jobs
+/// still run) and 0 otherwise
+int main(int argc, const char **argv) {
+    if (argc < 2)
+        return 1;
+
+    // parse arguments
+    std::string name;
+    bool gerber = false;
+    bool bom = false;
+    bool drill = false;
+    Manufacturer manufacturer = Manufacturer::GENERIC;
+    // only footprints and a few settings get accessed, therefore parse top level elements lazily
+    Options options = {.outDir = {}, .readOptions = {.threadCount = 0, .lazy = true}, .stream = false,
+        .compressionLevel = 6, .reproducible = false, .nativeDrill = false,
+        .snapshot = false, .verbose = false, .stats = false, .profiler = nullptr, .cache = nullptr, .force = false,
+        .watch = false};
+    bool threadCountSet = false;
+    int jobCount = 1;
+    fs::path profilePath;
+    std::vector<Job> jobs;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "-n") {
+            // set name of current job
+            ++i;
+            name = argv[i];
+        } else if (arg == "-g") {
+            // zip gerber
+            gerber = true;
+        } else if (arg == "-b") {
+            // create generic bom (includes voltage)
+            bom = true;
+        } else if (arg == "-j") {
+            // JLCPCB
+            manufacturer = Manufacturer::JLCPCB;
+        } else if (arg == "-d") {
+            // export drill
+            drill = true;
+        } else if (arg == "-t") {
+            // number of threads for parsing
+            ++i;
+            options.readOptions.threadCount = std::atoi(argv[i]);
+            threadCountSet = true;
+        } else if (arg == "--no-lazy") {
+            // parse the whole file up front
+            options.readOptions.lazy = false;
+        } else if (arg == "-s") {
+            // streaming read
+            options.stream = true;
+        } else if (arg == "-J") {
+            // number of parallel jobs
+            ++i;
+            jobCount = std::atoi(argv[i]);
+        } else if (arg == "-z") {
+            // compression level
+            ++i;
+            options.compressionLevel = std::atoi(argv[i]);
+        } else if (arg == "-r") {
+            // reproducible zip files
+            options.reproducible = true;
+        } else if (arg == "-e") {
+            // native Excellon export
+            options.nativeDrill = true;
+        } else if (arg == "--snapshot") {
+            // use binary snapshot
+            options.snapshot = true;
+        } else if (arg == "-v") {
+            // verbose output
+            options.verbose = true;
+        } else if (arg == "--stats") {
+            // memory statistics
+            options.stats = true;
+        } else if (arg == "--profile") {
+            // trace file
+            ++i;
+            profilePath = argv[i];
+        } else if (arg == "-f") {
+            // ignore the cache
+            options.force = true;
+        } else if (arg == "--watch") {
+            // watch mode
+            options.watch = true;
+        } else {
+            if (gerber || bom || drill) {
+                // argument is path to .kicad_pcb file: add job
+                fs::path pcbPath = arg;
+                if (name.empty())
+                    name = pcbPath.stem().string();
+
+                jobs.emplace_back(name, gerber, bom, manufacturer, drill, pcbPath);
+
+                // clear
+                name.clear();
+                gerber = false;
+                bom = false;
+                drill = false;
             } else {
-                std::cout << "Error: Could not create BOM/CPL file in " << outDir.string() << std::endl;
-                error = true;
+                // argument is output directory
+                options.outDir = arg;
             }
         }
+    }
 
-        if (job.drill) {
-            // open drill file for OpenSCAD export
-            fs::path drillPath = outDir / (job.name + ".scad");
-            std::ofstream drillFile(drillPath);
-
-            for (auto container1 : file) {
-                // check if it is a footprint
-                if (container1->id == "footprint") {
-                    auto footprint = container1;
-
-                    // get footprint name
-                    auto footprintName = footprint->getString(0);
-                    //std::cout << "Footprint: " << footprintName << std::endl;
-
-                    // get position and rotation of footprint
-                    double2 position = {0, 0};
-                    double rotation = 0;
-                    for (auto property : *footprint) {
-                        if (property->id == "at") {
-                            auto at = property;
-                            position.x = at->getNumber(0);
-                            position.y = at->getNumber(1);
-                            rotation = at->getNumber(2);
-                        }
-                    }
+    std::cout << "Output directory: " << options.outDir.string() << std::endl;
 
-                    // get drill holes
-                    bool first = true;
-                    for (auto property : *footprint) {
-                        if (property->id == "pad") {
-                            auto pad = property;
-
-                            std::string type = pad->getTag(1);
-                            if (type == "thru_hole" || type == "np_thru_hole") {
-                                // get pad name
-                                std::string padName = pad->getString(0);
-                                //std::cout << "  Pad: " << padName << std::endl;
-
-                                // get pad position
-                                auto at = pad->find("at");
-                                auto x = at->getNumber(0);
-                                auto y = at->getNumber(1);
-
-                                // get drill size
-                                auto drill = pad->find("drill");
-                                double w, h;
-                                if (drill->elements.size() == 1) {
-                                    w = h = drill->getNumber(0);
-                                } else {
-                                    w = drill->getNumber(1);
-                                    h = drill->getNumber(2);
-                                }
+    // record timings of all jobs if a trace file is given
+    std::optional<Profiler> profiler;
+    if (!profilePath.empty()) {
+        profiler.emplace();
+        options.profiler = &*profiler;
+    }
 
-                                // transform to global coordinates
-                                double r = rotation * pi / 180.0;
-                                double s = sin(r);
-                                double c = cos(r);
-                                double gX = position.x + c * x + s * y;
-                                double gY = position.y + c * y - s * x;
+    // parallel jobs parse single threaded unless configured otherwise
+    if (jobCount <= 0)
+        jobCount = std::max(int(std::thread::hardware_concurrency()), 1);
+    if (jobCount > 1 && !threadCountSet)
+        options.readOptions.threadCount = 1;
+
+    // load cache of previous runs from the output directory
+    fs::path cachePath = options.outDir / ".bom-tool-cache.json";
+    ProfileScope cacheScope(options.profiler, "load cache", "io");
+    Cache cache = loadCache(cachePath);
+    options.cache = &cache;
+    cacheScope.end();
+
+    // run jobs on a thread pool and print their output in order of the jobs when they are done, returns true if there
+    // were errors
+    std::vector<JobState> states(jobs.size());
+    auto run = [&](const std::vector<size_t> &indices) {
+        std::vector<JobLog> logs(indices.size());
+        std::vector<bool> done(indices.size());
+        std::mutex mutex;
+        std::condition_variable condition;
+        {
+            ThreadPool pool(std::clamp(int(indices.size()), 1, jobCount));
+            for (size_t i = 0; i < indices.size(); ++i) {
+                pool.submit([&, i] {
+                    auto &state = states[indices[i]];
+                    runJob(jobs[indices[i]], options, state, logs[i]);
+
+                    // the board is only needed again in watch mode
+                    if (!options.watch)
+                        state = {};
+                    std::lock_guard lock(mutex);
+                    done[i] = true;
+                    condition.notify_all();
+                });
+            }
+            for (size_t i = 0; i < indices.size(); ++i) {
+                std::unique_lock lock(mutex);
+                condition.wait(lock, [&] {return bool(done[i]);});
+                lock.unlock();
+                std::cout << logs[i].out.str() << std::flush;
+            }
+        }
 
-                                if (first) {
-                                    first = false;
-                                    drillFile << "// " << footprintName << std::endl;
-                                }
-                                drillFile << "drill(" << gX << ", " << gY << ", " << w << ", " << h << ", " << rotation << ");";
-                                if (!padName.empty())
-                                    drillFile << " // " << padName;
-                                drillFile << std::endl;
-                            }
-                        }
-                    }
-                    if (!first)
-                        drillFile << std::endl;
+        // update cache: replace entries of jobs that ran, remove entries of failed jobs so that they run again
+        bool error = false;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            auto &log = logs[i];
+            auto &job = jobs[indices[i]];
+            error |= log.errorCount > 0;
+            if (log.skipped)
+                continue;
+            if (log.cacheEntry.key != 0)
+                cache[job.name] = std::move(log.cacheEntry);
+            else
+                cache.erase(job.name);
+        }
+        ProfileScope saveScope(options.profiler, "save cache", "io");
+        if (!indices.empty() && !saveCache(cachePath, cache))
+            std::cout << "Warning: Could not write cache file " << cachePath.string() << std::endl;
+        saveScope.end();
+
+        // write trace file, in watch mode after each run as the process gets terminated
+        if (profiler) {
+            if (profiler->write(profilePath))
+                std::cout << "Wrote profile " << profilePath.string() << std::endl;
+            else
+                std::cout << "Warning: Could not write profile " << profilePath.string() << std::endl;
+        }
+
+        std::cout << std::endl;
+        if (error) {
+            std::cout << "!!! There were errors !!!" << std::endl;
+
+            // summary in order of the jobs
+            for (size_t i = 0; i < indices.size(); ++i) {
+                if (logs[i].errorCount == 0)
+                    continue;
+                std::cout << jobs[indices[i]].name << ':' << std::endl;
+                std::istringstream lines(logs[i].out.str());
+                std::string line;
+                while (std::getline(lines, line)) {
+                    if (line.starts_with("Error: "))
+                        std::cout << "  " << line << std::endl;
                 }
             }
+        } else {
+            std::cout << "*** OK ***" << std::endl;
         }
+
+        // peak resident set size is a high-water mark of the whole process since its start, not of a job or run
+        if (options.stats)
+            std::cout << "Peak memory of the process: " << getPeakMemory() / 1000000 << " MB" << std::endl;
+
+        // release the previous boards after the output is done
+        for (auto index : indices)
+            states[index].previousDocument.reset();
+        return error;
+    };
+
+    // run all jobs
+    std::vector<size_t> indices(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+        indices[i] = i;
+    bool error = run(indices);
+    if (!options.watch)
+        return error ? 1 : 0;
+
+    // watch the .kicad_pcb and .kicad_pro files of all jobs, a save in KiCad writes both files
+    FileWatcher watcher;
+    for (auto &job : jobs) {
+        fs::path projectPath = job.pcbPath;
+        projectPath.replace_extension(".kicad_pro");
+        watcher.add(job.pcbPath);
+        watcher.add(projectPath);
     }
 
-    std::cout << std::endl;
-    if (error)
-        std::cout << "!!! There were errors !!!" << std::endl;
-    else
-        std::cout << "*** OK ***" << std::endl;
-    return 0;
+    // the boards are kept in memory, therefore snapshots are not needed any more
+    options.snapshot = false;
+    while (true) {
+        std::cout << "Watching for changes" << (watcher.isPolling() ? " (polling)" : "") << ", press Ctrl+C to stop"
+            << std::endl;
+        auto changed = watcher.wait(std::chrono::milliseconds(50));
+
+        // run the jobs whose files changed
+        indices.clear();
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            fs::path projectPath = jobs[i].pcbPath;
+            projectPath.replace_extension(".kicad_pro");
+            if (std::ranges::find(changed, jobs[i].pcbPath) != changed.end()
+                || std::ranges::find(changed, projectPath) != changed.end())
+            {
+                indices.push_back(i);
+            }
+        }
+        std::cout << std::endl;
+        run(indices);
+    }
 }
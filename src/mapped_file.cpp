@@ -0,0 +1,133 @@
+#include "mapped_file.hpp"
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : address(std::exchange(other.address, nullptr))
+    , size(std::exchange(other.size, 0))
+    , opened(std::exchange(other.opened, false))
+#ifdef _WIN32
+    , mapping(std::exchange(other.mapping, nullptr))
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile &MappedFile::operator =(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        this->address = std::exchange(other.address, nullptr);
+        this->size = std::exchange(other.size, 0);
+        this->opened = std::exchange(other.opened, false);
+#ifdef _WIN32
+        this->mapping = std::exchange(other.mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::filesystem::path &path) {
+    close();
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // only regular files can be mapped
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        // empty file can't be mapped
+        CloseHandle(file);
+        this->opened = true;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+    void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (address == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+    this->address = static_cast<const char *>(address);
+    this->size = size_t(size.QuadPart);
+    this->mapping = mapping;
+    this->opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->address != nullptr)
+        UnmapViewOfFile(this->address);
+    if (this->mapping != nullptr)
+        CloseHandle(this->mapping);
+    this->address = nullptr;
+    this->size = 0;
+    this->mapping = nullptr;
+    this->opened = false;
+}
+
+#else
+
+bool MappedFile::open(const std::filesystem::path &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    // only regular files can be mapped
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        // empty file can't be mapped
+        ::close(fd);
+        this->opened = true;
+        return true;
+    }
+
+    void *address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return false;
+#ifdef MADV_SEQUENTIAL
+    madvise(address, st.st_size, MADV_SEQUENTIAL);
+#endif
+    this->address = static_cast<const char *>(address);
+    this->size = size_t(st.st_size);
+    this->opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->address != nullptr)
+        munmap(const_cast<char *>(this->address), this->size);
+    this->address = nullptr;
+    this->size = 0;
+    this->opened = false;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+
+/// @brief Read-only memory mapping of a file
+///
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    ~MappedFile();
+    MappedFile &operator =(MappedFile &&other) noexcept;
+
+    /// @brief Map a file into memory.
+    /// @param path Path of the file
+    /// @return true on success, false if the file can't be opened or is not a regular file (e.g. a pipe or socket)
+    bool open(const std::filesystem::path &path);
+
+    /// @brief Unmap the file
+    void close();
+
+    /// @brief Check if a file is mapped
+    /// @return true if open() was successful
+    bool isOpen() const {return this->opened;}
+
+    /// @brief Get the contents of the file
+    /// @return Contents, valid until the file gets closed
+    std::string_view data() const {return {this->address, this->size};}
+
+protected:
+    const char *address = nullptr;
+    size_t size = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void *mapping = nullptr;
+#endif
+};
@@ -0,0 +1,116 @@
+#include "process.hpp"
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+
+#ifdef _WIN32
+
+ProcessResult runProcess(const std::vector<std::string> &arguments) {
+    ProcessResult result;
+
+    // build command line, quote arguments that contain spaces
+    std::string command;
+    for (auto &argument : arguments) {
+        if (!command.empty())
+            command += ' ';
+        if (argument.find(' ') != std::string::npos)
+            command += '"' + argument + '"';
+        else
+            command += argument;
+    }
+    command += " 2>&1";
+
+    FILE *pipe = _popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        result.output = "Can't start " + arguments[0] + '\n';
+        return result;
+    }
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        result.output.append(buffer, size);
+    result.exitCode = _pclose(pipe);
+    return result;
+}
+
+#else
+
+namespace {
+
+// create a pipe that does not get inherited by other processes that are started concurrently
+bool createPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0)
+        return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+} // anonymous namespace
+
+ProcessResult runProcess(const std::vector<std::string> &arguments) {
+    ProcessResult result;
+
+    int fds[2];
+    if (!createPipe(fds)) {
+        result.output = "Can't create pipe\n";
+        return result;
+    }
+
+    // redirect stdout and stderr of the process into the pipe
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+    std::vector<char *> argv;
+    for (auto &argument : arguments)
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int r = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (r != 0) {
+        close(fds[0]);
+        result.output = "Can't start " + arguments[0] + ": " + strerror(r) + '\n';
+        return result;
+    }
+
+    // read output until the process closes the pipe
+    char buffer[4096];
+    while (true) {
+        ssize_t size = read(fds[0], buffer, sizeof(buffer));
+        if (size > 0)
+            result.output.append(buffer, size);
+        else if (size == 0 || errno != EINTR)
+            break;
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return result;
+    }
+    if (WIFEXITED(status))
+        result.exitCode = WEXITSTATUS(status);
+    return result;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/// @brief Result of a process
+///
+struct ProcessResult {
+    // exit code of the process, -1 if the process could not be started or did not exit normally
+    int exitCode = -1;
+
+    // captured stdout and stderr of the process
+    std::string output;
+};
+
+/// @brief Run a process without a shell and wait until it exits. Blocks the calling thread, therefore run it on a
+/// separate thread (e.g. std::async) to run several processes concurrently
+/// @param arguments Program (searched in PATH) and its arguments, e.g. {"kicad-cli", "version"}
+/// @return Exit code and output of the process
+ProcessResult runProcess(const std::vector<std::string> &arguments);
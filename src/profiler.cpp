@@ -0,0 +1,93 @@
+#include "profiler.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <fstream>
+
+using json = nlohmann::json;
+
+
+// Profiler
+
+Profiler::Profiler()
+    : start(Clock::now())
+{
+    this->threads.push_back(std::this_thread::get_id());
+}
+
+void Profiler::add(Event event) {
+    std::lock_guard lock(this->mutex);
+    event.thread = getThread();
+    this->events.push_back(std::move(event));
+}
+
+bool Profiler::write(const std::filesystem::path &path) {
+    std::lock_guard lock(this->mutex);
+
+    // timestamps in microseconds since the start of the profiler
+    auto us = [this](Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    json events = json::array();
+    events.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", 1}, {"args", {{"name", "bom-tool"}}}});
+    for (size_t i = 0; i < this->threads.size(); ++i) {
+        std::string name = i == 0 ? "main" : "thread " + std::to_string(i);
+        events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", i}, {"args", {{"name", name}}}});
+    }
+
+    // complete events ("X") sorted by start time
+    std::vector<const Event *> sorted;
+    for (auto &event : this->events)
+        sorted.push_back(&event);
+    std::ranges::stable_sort(sorted, {}, [](const Event *event) {return event->start;});
+    for (auto event : sorted) {
+        json args = json::object();
+        for (auto &[name, value] : event->numbers)
+            args[name] = value;
+        for (auto &[name, value] : event->strings)
+            args[name] = value;
+        events.push_back({
+            {"name", event->name},
+            {"cat", event->category},
+            {"ph", "X"},
+            {"ts", us(event->start - this->start)},
+            {"dur", us(event->end - event->start)},
+            {"pid", 1},
+            {"tid", event->thread},
+            {"args", args}});
+    }
+
+    std::ofstream os(path.string());
+    os << json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump(1) << std::endl;
+    return bool(os);
+}
+
+int Profiler::getThread() {
+    auto id = std::this_thread::get_id();
+    auto it = std::ranges::find(this->threads, id);
+    if (it != this->threads.end())
+        return int(it - this->threads.begin());
+    this->threads.push_back(id);
+    return int(this->threads.size() - 1);
+}
+
+
+// ProfileScope
+
+ProfileScope::ProfileScope(Profiler *profiler, std::string_view name, std::string_view category)
+    : profiler(profiler)
+{
+    if (profiler != nullptr) {
+        this->event.name = name;
+        this->event.category = category;
+        this->event.start = Profiler::Clock::now();
+    }
+}
+
+void ProfileScope::end() {
+    if (this->profiler != nullptr) {
+        this->event.end = Profiler::Clock::now();
+        this->profiler->add(std::move(this->event));
+        this->profiler = nullptr;
+    }
+}
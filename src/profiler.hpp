@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/// @brief Collects timed events of all threads and writes them in the Chrome trace event format, which can be loaded
+/// into chrome://tracing or ui.perfetto.dev. Thread safe
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief Timed event, e.g. a phase of a job or a subprocess
+    ///
+    struct Event {
+        // name, e.g. "read board"
+        std::string name;
+
+        // category, e.g. "phase", "process" or "io"
+        std::string category;
+
+        Clock::time_point start;
+        Clock::time_point end;
+
+        // index of the thread that recorded the event
+        int thread;
+
+        // numeric arguments, e.g. bytes written
+        std::vector<std::pair<std::string, int64_t>> numbers;
+
+        // string arguments, e.g. path of a file
+        std::vector<std::pair<std::string, std::string>> strings;
+    };
+
+    Profiler();
+
+    /// @brief Add an event, the thread gets set to the calling thread
+    /// @param event Event
+    void add(Event event);
+
+    /// @brief Write all events as Chrome trace event JSON
+    /// @param path Path of the trace file
+    /// @return true on success
+    bool write(const std::filesystem::path &path);
+
+protected:
+    // get a small index of the calling thread, 0 is the thread that created the profiler
+    int getThread();
+
+    Clock::time_point start;
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::vector<std::thread::id> threads;
+};
+
+
+/// @brief Records the time from construction to end() or destruction as event of a profiler. Does nothing if the
+/// profiler is null, so that it can stay in the code when profiling is disabled
+class ProfileScope {
+public:
+    /// @brief Constructor, starts the timer
+    /// @param profiler Profiler or nullptr if profiling is disabled
+    /// @param name Name of the event, e.g. "read board"
+    /// @param category Category of the event, e.g. "phase"
+    ProfileScope(Profiler *profiler, std::string_view name, std::string_view category = "phase");
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    /// @brief Destructor, calls end()
+    ~ProfileScope() {end();}
+
+    /// @brief Add a numeric argument, e.g. number of bytes written
+    void arg(std::string_view name, int64_t value) {
+        if (this->profiler != nullptr)
+            this->event.numbers.emplace_back(name, value);
+    }
+
+    /// @brief Add a string argument, e.g. the path of a file
+    void arg(std::string_view name, std::string_view value) {
+        if (this->profiler != nullptr)
+            this->event.strings.emplace_back(name, value);
+    }
+
+    /// @brief Stop the timer and add the event to the profiler, further calls do nothing
+    void end();
+
+protected:
+    Profiler *profiler;
+    Profiler::Event event;
+};
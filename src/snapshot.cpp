@@ -0,0 +1,385 @@
+#include "snapshot.hpp"
+#include "hash.hpp"
+#include "string_pool.hpp"
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace kicad {
+
+namespace {
+
+constexpr char MAGIC[8] = {'K', 'I', 'S', 'N', 'A', 'P', '\r', '\n'};
+constexpr uint32_t VERSION = 2;
+constexpr int ATOM_COUNT = int(Atom::ZONE_CONNECT) + 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+
+    // number of strings, the string table has stringCount + 1 offsets
+    uint32_t stringCount;
+
+    // hash of the keywords of all atoms, atoms are stored as numbers and change when keywords get added
+    uint64_t atomHash;
+
+    // hash of the source file
+    uint64_t sourceHash;
+
+    uint32_t topCount;
+    uint32_t nodeCount;
+    uint32_t stringDataSize;
+    uint32_t reserved;
+};
+
+struct Node {
+    // index of the id of a container or the value
+    uint32_t string;
+
+    // index of the node after the last descendant, index + 1 for values
+    uint32_t end;
+
+    // atom of the id of a container
+    uint16_t atom;
+
+    // VALUE or CONTAINER
+    uint16_t kind;
+};
+
+constexpr uint16_t VALUE = 0;
+constexpr uint16_t CONTAINER = 1;
+
+// copy of a node of the root container, so that opening a snapshot only touches the pages of the top level nodes
+struct Top {
+    uint32_t index;
+    Node node;
+
+    // hash64() of the text of the container in the source file, low and high half to keep the 4 byte alignment, 0 if
+    // unknown
+    uint32_t hash[2];
+};
+
+// layout: header, string offsets, top level nodes, nodes, string data
+static_assert(sizeof(Header) % 4 == 0 && sizeof(Node) % 4 == 0 && sizeof(Top) % 4 == 0);
+
+// get a temporary path next to a file that is unique for each writer, also across processes that write a snapshot of
+// the same board
+std::filesystem::path getTempPath(const std::filesystem::path &path) {
+    static std::atomic<uint32_t> counter;
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = int(getpid());
+#endif
+    auto tempPath = path;
+    tempPath += ".tmp." + std::to_string(pid) + '.' + std::to_string(counter++);
+    return tempPath;
+}
+
+uint64_t getAtomHash() {
+    std::string keywords;
+    for (int i = 0; i < ATOM_COUNT; ++i) {
+        keywords += toString(Atom(i));
+        keywords += ' ';
+    }
+    return hash64(keywords);
+}
+
+// create an object in a memory resource, gets destroyed when the resource is released
+template <typename T, typename ...Args>
+T *create(std::pmr::memory_resource *resource, Args &&...args) {
+    return new (resource->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+// tables of a memory mapped snapshot
+struct Tables {
+    const uint32_t *offsets;
+    uint32_t stringCount;
+    const char *stringData;
+    uint32_t stringDataSize;
+    const Node *nodes;
+
+    // get a string, empty if the offsets are invalid
+    std::string_view getString(uint32_t index) const {
+        uint32_t begin = this->offsets[index];
+        uint32_t end = this->offsets[index + 1];
+        if (begin > end || end > this->stringDataSize)
+            return {};
+        return {this->stringData + begin, end - begin};
+    }
+};
+
+// create the elements of a container node including all sub-containers. The nodes get checked here instead of when
+// the snapshot is opened, the elements end at the first invalid node
+void createElements(const Tables &tables, uint32_t index, uint32_t end, std::pmr::memory_resource *resource,
+    std::vector<Element *> &elements)
+{
+    // collect elements on a stack like Builder and copy them into the containers when they are complete
+    auto nodes = tables.nodes;
+    std::vector<Container *> containers;
+    std::vector<uint32_t> ends;
+    std::vector<size_t> marks;
+    auto complete = [&] {
+        size_t mark = marks.back();
+        containers.back()->elements.assign(elements.begin() + mark, elements.end());
+        elements.resize(mark);
+        containers.pop_back();
+        ends.pop_back();
+        marks.pop_back();
+    };
+    for (uint32_t i = index + 1; ; ++i) {
+        while (!ends.empty() && ends.back() == i)
+            complete();
+        if (i == end)
+            break;
+
+        auto &node = nodes[i];
+        if (node.string >= tables.stringCount)
+            break;
+        if (node.kind == CONTAINER) {
+            uint32_t parentEnd = ends.empty() ? end : ends.back();
+            if (node.end <= i || node.end > parentEnd || node.atom >= ATOM_COUNT)
+                break;
+            auto container = create<Container>(resource, tables.getString(node.string), Atom(node.atom), resource);
+            elements.push_back(container);
+            containers.push_back(container);
+            ends.push_back(node.end);
+            marks.push_back(elements.size());
+        } else {
+            if (node.kind != VALUE || node.end != i + 1)
+                break;
+            elements.push_back(create<Value>(resource, tables.getString(node.string)));
+        }
+    }
+
+    // close the open containers of an invalid snapshot
+    while (!containers.empty())
+        complete();
+}
+
+// elements of a top level container that get created from the snapshot on first access
+class SnapshotElements : public DeferredElements {
+public:
+    SnapshotElements(const Tables *tables, uint32_t index, uint32_t end, uint64_t hash)
+        : tables(tables), index(index), end(end), hash(hash) {}
+
+    void expand(std::pmr::memory_resource *resource, std::vector<Element *> &elements) override {
+        createElements(*this->tables, this->index, this->end, resource, elements);
+    }
+
+    uint64_t getHash() override {
+        return this->hash;
+    }
+
+protected:
+    const Tables *tables;
+    uint32_t index;
+    uint32_t end;
+    uint64_t hash;
+};
+
+} // anonymous namespace
+
+
+bool writeSnapshot(const std::filesystem::path &path, Container &root, uint64_t sourceHash,
+    std::span<const uint64_t> footprintHashes)
+{
+    // deferred containers get expanded into copies in a scratch arena that is released after each top level
+    // container, the document stays as it is
+    std::pmr::monotonic_buffer_resource scratch;
+    auto expand = [&scratch](Container *container) {
+        if (container->deferred == Container::Deferred::NO)
+            return container;
+        auto copy = create<Container>(&scratch, container->id, container->atom, &scratch);
+        copy->elements.push_back(container->elements.front());
+        copy->deferred = container->deferred;
+        copy->expand();
+        return copy;
+    };
+
+    // flatten the tree in pre-order
+    StringPool strings;
+    std::vector<Node> nodes;
+    std::vector<uint64_t> topHashes;
+    size_t footprintIndex = 0;
+    std::vector<std::pair<Container *, size_t>> stack;
+    nodes.push_back({strings.add(root.id), 0, uint16_t(root.atom), CONTAINER});
+    stack.push_back({expand(&root), 0});
+    std::vector<size_t> parents = {0};
+    while (!stack.empty()) {
+        auto &[container, next] = stack.back();
+        if (next == container->elements.size()) {
+            // container is complete
+            nodes[parents.back()].end = uint32_t(nodes.size());
+            parents.pop_back();
+            stack.pop_back();
+            if (stack.size() == 1)
+                scratch.release();
+            continue;
+        }
+        auto element = container->elements[next++];
+        if (auto value = element->asValue()) {
+            if (stack.size() == 1)
+                topHashes.push_back(0);
+            nodes.push_back({strings.add(value->value), uint32_t(nodes.size() + 1), 0, VALUE});
+        } else {
+            auto child = element->asContainer();
+            if (stack.size() == 1) {
+                // hash of the text of a top level container, footprints were parsed by the footprint table
+                uint64_t hash = child->getDeferredHash();
+                if (child->atom == Atom::FOOTPRINT) {
+                    if (hash == 0 && footprintIndex < footprintHashes.size())
+                        hash = footprintHashes[footprintIndex];
+                    ++footprintIndex;
+                }
+                topHashes.push_back(hash);
+            }
+            parents.push_back(nodes.size());
+            nodes.push_back({strings.add(child->id), 0, uint16_t(child->atom), CONTAINER});
+            stack.push_back({expand(child), 0});
+        }
+    }
+
+    // top level nodes
+    std::vector<Top> tops;
+    for (uint32_t i = 1; i < nodes.size(); i = nodes[i].end) {
+        uint64_t hash = topHashes[tops.size()];
+        tops.push_back({i, nodes[i], {uint32_t(hash), uint32_t(hash >> 32)}});
+    }
+
+    // string table
+    std::vector<uint32_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    std::string stringData;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        offsets.push_back(uint32_t(stringData.size()));
+        stringData += strings[i];
+    }
+    offsets.push_back(uint32_t(stringData.size()));
+    if (nodes.size() > UINT32_MAX || stringData.size() > UINT32_MAX)
+        return false;
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.stringCount = uint32_t(strings.size());
+    header.atomHash = getAtomHash();
+    header.sourceHash = sourceHash;
+    header.topCount = uint32_t(tops.size());
+    header.nodeCount = uint32_t(nodes.size());
+    header.stringDataSize = uint32_t(stringData.size());
+
+    // write to a temporary file and rename it, concurrent writers of the same snapshot use different temporary files
+    auto tempPath = getTempPath(path);
+    std::error_code ec;
+    {
+        std::ofstream s(tempPath, std::ios::binary | std::ios::trunc);
+        s.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        s.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        s.write(reinterpret_cast<const char *>(tops.data()), tops.size() * sizeof(Top));
+        s.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(Node));
+        s.write(stringData.data(), stringData.size());
+        s.close();
+        if (s.fail()) {
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::error_code ec2;
+        std::filesystem::remove(tempPath, ec2);
+        return false;
+    }
+    return true;
+}
+
+bool readSnapshot(const std::filesystem::path &path, Document &document, uint64_t sourceHash) {
+    document.clear();
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    auto data = file.data();
+
+    // check header
+    Header header;
+    if (data.size() < sizeof(Header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || header.atomHash != getAtomHash() || header.sourceHash != sourceHash || header.nodeCount == 0)
+    {
+        return false;
+    }
+    size_t offsetsSize = (size_t(header.stringCount) + 1) * sizeof(uint32_t);
+    size_t topsSize = size_t(header.topCount) * sizeof(Top);
+    size_t nodesSize = size_t(header.nodeCount) * sizeof(Node);
+    if (data.size() != sizeof(Header) + offsetsSize + topsSize + nodesSize + header.stringDataSize)
+        return false;
+
+    // the mapping is page aligned, therefore the tables are aligned
+    const char *p = data.data() + sizeof(Header);
+    Tables tables = {
+        reinterpret_cast<const uint32_t *>(p),
+        header.stringCount,
+        p + offsetsSize + topsSize + nodesSize,
+        header.stringDataSize,
+        reinterpret_cast<const Node *>(p + offsetsSize + topsSize)};
+    auto tops = reinterpret_cast<const Top *>(p + offsetsSize);
+
+    // root container
+    auto &rootNode = tables.nodes[0];
+    if (rootNode.kind != CONTAINER || rootNode.string >= header.stringCount || rootNode.atom >= ATOM_COUNT)
+        return false;
+    auto &root = document.root;
+    root.id = tables.getString(rootNode.string);
+    root.atom = Atom(rootNode.atom);
+
+    // create the top level elements from the top level table, the elements of containers get created from the
+    // snapshot on first access
+    auto resource = document.resource();
+    auto t = create<Tables>(resource, tables);
+    std::vector<Element *> elements;
+    uint32_t index = 1;
+    for (uint32_t i = 0; i < header.topCount; ++i) {
+        auto &top = tops[i];
+        auto &node = top.node;
+        if (top.index != index || node.string >= header.stringCount || node.end <= index
+            || node.end > header.nodeCount || (node.kind == CONTAINER && node.atom >= ATOM_COUNT))
+        {
+            document.clear();
+            return false;
+        }
+        if (node.kind == CONTAINER) {
+            auto container = create<Container>(resource, tables.getString(node.string), Atom(node.atom), resource);
+            uint64_t hash = uint64_t(top.hash[0]) | uint64_t(top.hash[1]) << 32;
+            container->elements.push_back(create<SnapshotElements>(resource, t, index, node.end, hash));
+            container->deferred = Container::Deferred::CUSTOM;
+            elements.push_back(container);
+        } else {
+            elements.push_back(create<Value>(resource, tables.getString(node.string)));
+        }
+        index = node.end;
+    }
+    if (index != header.nodeCount) {
+        document.clear();
+        return false;
+    }
+    root.elements.assign(elements.begin(), elements.end());
+
+    // ids and values reference the mapping
+    document.source = std::move(file);
+    return true;
+}
+
+} // namespace kicad
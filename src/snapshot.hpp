@@ -0,0 +1,35 @@
+#pragma once
+
+#include "kicad.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+
+namespace kicad {
+
+/// @brief Write a binary snapshot of a document that can be read much faster than the text file. The snapshot
+/// consists of a header, a string table, a table of the top level nodes and a flat array of nodes in pre-order where
+/// each container node stores the index after its last descendant, so that sub-trees can be skipped without reading
+/// them. Containers of a lazily read document get expanded into a scratch arena, the document does not change. The
+/// hash of the text of each top level container is stored as well (see Container::getDeferredHash()). The file is
+/// written to a temporary file with a name unique to the writer first and then renamed, so that concurrent readers
+/// never see a partial snapshot and concurrent writers (e.g. two jobs of the same board) do not mix their files.
+/// @param path Path of the snapshot, e.g. "board.kicad_pcb.snapshot"
+/// @param root Root container of the document
+/// @param sourceHash Hash of the source file (see hashFile()), a snapshot is only valid for this source
+/// @param footprintHashes Hashes of the footprints that were already parsed (see FootprintTable::textHashes)
+/// @return true on success
+bool writeSnapshot(const std::filesystem::path &path, Container &root, uint64_t sourceHash,
+    std::span<const uint64_t> footprintHashes = {});
+
+/// @brief Read a snapshot written by writeSnapshot(). The snapshot gets memory mapped and ids and values reference
+/// the mapping. Only the top level containers get created, their elements get created from the snapshot on first
+/// access like with ReadOptions::lazy. Nodes are checked when they get created, an invalid sub-tree ends early
+/// @param path Path of the snapshot
+/// @param document Document to read into, gets cleared first
+/// @param sourceHash Hash of the source file
+/// @return true if the snapshot exists, is valid and was written for the given source hash
+bool readSnapshot(const std::filesystem::path &path, Document &document, uint64_t sourceHash);
+
+} // namespace kicad
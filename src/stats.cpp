@@ -0,0 +1,125 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+namespace kicad {
+
+namespace {
+
+// check if a string lies within a text
+bool contains(std::string_view text, std::string_view str) {
+    return !text.empty() && std::less_equal<>()(text.data(), str.data())
+        && std::less_equal<>()(str.data() + str.size(), text.data() + text.size());
+}
+
+void addStats(DocumentStats &stats, Container &container, std::string_view source, std::string_view text) {
+    ++stats.containerCount;
+    auto it = stats.containerCounts.find(container.id);
+    if (it == stats.containerCounts.end())
+        it = stats.containerCounts.emplace(container.id, 0).first;
+    ++it->second;
+    stats.elementBytes += container.elements.capacity() * sizeof(Element *);
+    stats.unusedElementBytes += (container.elements.capacity() - container.elements.size()) * sizeof(Element *);
+
+    // do not expand deferred containers
+    if (container.deferred != Container::Deferred::NO) {
+        ++stats.deferredCount;
+        if (container.deferred == Container::Deferred::TEXT)
+            stats.deferredBytes += container.elements.front()->asValue()->value.size();
+        return;
+    }
+
+    for (auto element : container.elements) {
+        if (auto value = element->asValue()) {
+            ++stats.valueCount;
+            if (contains(source, value->value) || contains(text, value->value))
+                stats.sourceValueBytes += value->value.size();
+            else
+                stats.copiedValueBytes += value->value.size();
+        } else {
+            addStats(stats, *element->asContainer(), source, text);
+        }
+    }
+}
+
+// format a number of bytes, e.g. "12.3 MB"
+std::string formatBytes(size_t bytes) {
+    char buffer[32];
+    if (bytes < 10000)
+        std::snprintf(buffer, sizeof(buffer), "%zu B", bytes);
+    else if (bytes < 10000000)
+        std::snprintf(buffer, sizeof(buffer), "%.1f kB", bytes / 1e3);
+    else
+        std::snprintf(buffer, sizeof(buffer), "%.1f MB", bytes / 1e6);
+    return buffer;
+}
+
+} // anonymous namespace
+
+
+DocumentStats getStats(Document &document) {
+    DocumentStats stats;
+    addStats(stats, document.root, document.source.data(), document.text);
+    stats.arenaBytes = document.memory.size();
+    stats.peakArenaBytes = document.memory.peak();
+    stats.sourceBytes = document.source.data().size();
+    stats.bufferBytes = document.buffer.size();
+    return stats;
+}
+
+void printStats(std::ostream &s, const DocumentStats &stats) {
+    size_t nodeBytes = stats.containerCount * sizeof(Container) + stats.valueCount * sizeof(Value);
+    s << "Memory:" << std::endl;
+    s << "  containers: " << stats.containerCount << " (" << sizeof(Container) << " bytes each), values: "
+        << stats.valueCount << " (" << sizeof(Value) << " bytes each), total " << formatBytes(nodeBytes) << std::endl;
+    if (stats.deferredCount > 0) {
+        s << "  not parsed: " << stats.deferredCount << " containers";
+        if (stats.deferredBytes > 0)
+            s << ", " << formatBytes(stats.deferredBytes) << " of text";
+        s << std::endl;
+    }
+    s << "  value strings: " << formatBytes(stats.sourceValueBytes) << " in source file, "
+        << formatBytes(stats.copiedValueBytes) << " copied" << std::endl;
+    s << "  element vectors: " << formatBytes(stats.elementBytes) << ", unused capacity "
+        << formatBytes(stats.unusedElementBytes) << std::endl;
+    s << "  tree heap: " << formatBytes(stats.arenaBytes) << " reserved by arenas (peak "
+        << formatBytes(stats.peakArenaBytes) << "), source file: " << formatBytes(stats.sourceBytes) << " mapped, "
+        << formatBytes(stats.bufferBytes) << " buffered" << std::endl;
+
+    // containers by decreasing count
+    std::vector<std::pair<std::string_view, size_t>> counts(stats.containerCounts.begin(),
+        stats.containerCounts.end());
+    std::ranges::stable_sort(counts, std::greater<>(), [](const auto &count) {return count.second;});
+    s << "Containers:" << std::endl;
+    for (auto &[id, count] : counts)
+        s << "  " << (id.empty() ? "(root)" : id) << ": " << count << std::endl;
+}
+
+} // namespace kicad
+
+size_t getPeakMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return size_t(usage.ru_maxrss);
+#else
+    return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "kicad.hpp"
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+
+
+namespace kicad {
+
+/// @brief Memory statistics of a document
+///
+struct DocumentStats {
+    // number of containers by id, e.g. "footprint"
+    std::map<std::string, size_t, std::less<>> containerCounts;
+
+    // number of containers and values
+    size_t containerCount = 0;
+    size_t valueCount = 0;
+
+    // number of containers whose elements were not parsed yet (see ReadOptions::lazy), their sub-containers are not
+    // counted
+    size_t deferredCount = 0;
+
+    // bytes of Value::value strings that reference the source file and that were copied into the arena
+    size_t sourceValueBytes = 0;
+    size_t copiedValueBytes = 0;
+
+    // bytes of the text of deferred containers
+    size_t deferredBytes = 0;
+
+    // bytes of the elements vectors of all containers and the part of it that is unused capacity
+    size_t elementBytes = 0;
+    size_t unusedElementBytes = 0;
+
+    // bytes allocated by the arenas of the document (elements, copied strings and indices), current and peak. The
+    // arenas grow in blocks of increasing size, therefore this includes memory that is reserved but not used yet
+    size_t arenaBytes = 0;
+    size_t peakArenaBytes = 0;
+
+    // bytes of the source file, either memory mapped or copied into a buffer if the file was read from a stream
+    size_t sourceBytes = 0;
+    size_t bufferBytes = 0;
+};
+
+/// @brief Get memory statistics of a document. Deferred containers do not get expanded, therefore the statistics
+/// describe the document as it is in memory
+/// @param document Document
+/// @return Statistics
+DocumentStats getStats(Document &document);
+
+/// @brief Print statistics in human readable form, containers are listed by decreasing count
+/// @param s Output stream
+/// @param stats Statistics
+void printStats(std::ostream &s, const DocumentStats &stats);
+
+} // namespace kicad
+
+/// @brief Get the peak resident set size of the process since its start, it never decreases
+/// @return Peak memory in bytes, 0 if not supported on the platform
+size_t getPeakMemory();
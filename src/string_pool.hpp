@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/// @brief Pool of unique strings where each string is identified by an index. The strings are not copied and must
+/// stay valid as long as the pool is used, e.g. strings of a kicad::FootprintTable
+class StringPool {
+public:
+    /// @brief Add a string to the pool
+    /// @param str String to add
+    /// @return Index of the string, the same string always gets the same index
+    uint32_t add(std::string_view str) {
+        auto [it, inserted] = this->indices.try_emplace(str, uint32_t(this->strings.size()));
+        if (inserted)
+            this->strings.push_back(str);
+        return it->second;
+    }
+
+    /// @brief Get a string by index
+    std::string_view operator [](uint32_t index) const {return this->strings[index];}
+
+    /// @brief Number of strings in the pool
+    size_t size() const {return this->strings.size();}
+
+protected:
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> indices;
+};
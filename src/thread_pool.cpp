@@ -0,0 +1,75 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int threadCount) {
+    if (threadCount <= 0)
+        threadCount = std::max(int(std::thread::hardware_concurrency()), 1);
+
+    this->queues = std::vector<Queue>(threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        this->threads.emplace_back([this, i] {run(i);});
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(this->mutex);
+        this->stop = true;
+    }
+    this->condition.notify_all();
+
+    // workers finish the remaining tasks before they exit
+    this->threads.clear();
+}
+
+void ThreadPool::submit(Task task) {
+    // count the task before it gets published, otherwise a worker could take it and decrement the counter first
+    auto &queue = this->queues[this->next++ % this->queues.size()];
+    {
+        std::lock_guard lock(this->mutex);
+        ++this->queued;
+    }
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    this->condition.notify_one();
+}
+
+void ThreadPool::run(size_t index) {
+    while (true) {
+        Task task;
+        if (take(index, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock lock(this->mutex);
+        this->condition.wait(lock, [this] {return this->stop || this->queued > 0;});
+        if (this->stop && this->queued == 0)
+            return;
+    }
+}
+
+bool ThreadPool::take(size_t index, Task &task) {
+    size_t count = this->queues.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto &queue = this->queues[(index + i) % count];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            if (i == 0) {
+                // own queue: oldest task first
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            } else {
+                // steal from the other end
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            --this->queued;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// @brief Work-stealing thread pool. Each worker has its own queue and takes tasks from the queues of other workers
+/// when its own queue is empty
+class ThreadPool {
+public:
+    using Task = std::function<void ()>;
+
+    /// @brief Constructor
+    /// @param threadCount Number of worker threads, 0 for number of cores
+    explicit ThreadPool(int threadCount);
+
+    /// @brief Destructor, waits until all tasks are done
+    ~ThreadPool();
+
+    /// @brief Submit a task, tasks get distributed over the queues of the workers in round-robin order
+    /// @param task Task to run on one of the worker threads
+    void submit(Task task);
+
+    /// @brief Number of worker threads
+    int size() const {return int(this->threads.size());}
+
+protected:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+
+    // take a task from the own queue or steal one from another queue
+    bool take(size_t index, Task &task);
+
+    std::vector<Queue> queues;
+    std::atomic<size_t> next = 0;
+
+    // sleeping workers wait until a task gets submitted
+    std::mutex mutex;
+    std::condition_variable condition;
+    // number of submitted tasks that were not taken yet, gets incremented before a task is added to a queue so that
+    // it never underflows
+    std::atomic<size_t> queued = 0;
+    bool stop = false;
+
+    std::vector<std::jthread> threads;
+};
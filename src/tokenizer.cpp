@@ -0,0 +1,257 @@
+#include "tokenizer.hpp"
+#include <bit>
+#include <charconv>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+namespace kicad {
+
+namespace {
+
+// scalar
+
+size_t skipWhitespaceScalar(const char *buffer, size_t pos, size_t end) {
+    while (pos < end && uint8_t(buffer[pos]) <= ' ')
+        ++pos;
+    return pos;
+}
+
+size_t findIdentifierEndScalar(const char *buffer, size_t pos, size_t end) {
+    while (pos < end && buffer[pos] != ')' && uint8_t(buffer[pos]) > ' ')
+        ++pos;
+    return pos;
+}
+
+size_t findQuoteOrEscapeScalar(const char *buffer, size_t pos, size_t end) {
+    while (pos < end && buffer[pos] != '"' && buffer[pos] != '\\')
+        ++pos;
+    return pos;
+}
+
+const Scanner scalarScanner = {
+    skipWhitespaceScalar,
+    findIdentifierEndScalar,
+    findQuoteOrEscapeScalar,
+};
+
+
+#ifdef SCAN_X86
+
+// SSE2, 16 bytes at a time
+
+// mask of bytes that are whitespace or control characters (<= ' ')
+inline int whitespaceMask(__m128i v) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(' ')), _mm_set1_epi8(' ')));
+}
+
+size_t skipWhitespaceSse2(const char *buffer, size_t pos, size_t end) {
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer + pos));
+        unsigned mask = ~whitespaceMask(v) & 0xffff;
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 16;
+    }
+    return skipWhitespaceScalar(buffer, pos, end);
+}
+
+size_t findIdentifierEndSse2(const char *buffer, size_t pos, size_t end) {
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer + pos));
+        unsigned mask = whitespaceMask(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 16;
+    }
+    return findIdentifierEndScalar(buffer, pos, end);
+}
+
+size_t findQuoteOrEscapeSse2(const char *buffer, size_t pos, size_t end) {
+    while (pos + 16 <= end) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer + pos));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 16;
+    }
+    return findQuoteOrEscapeScalar(buffer, pos, end);
+}
+
+const Scanner sse2Scanner = {
+    skipWhitespaceSse2,
+    findIdentifierEndSse2,
+    findQuoteOrEscapeSse2,
+};
+
+
+// AVX2, 32 bytes at a time
+
+TARGET_AVX2 inline unsigned whitespaceMask(__m256i v) {
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(' ')),
+        _mm256_set1_epi8(' '))));
+}
+
+TARGET_AVX2 size_t skipWhitespaceAvx2(const char *buffer, size_t pos, size_t end) {
+    // most runs are short, therefore check 16 bytes first
+    if (pos + 16 <= end) {
+        size_t p = skipWhitespaceSse2(buffer, pos, pos + 16);
+        if (p < pos + 16)
+            return p;
+        pos = p;
+    }
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buffer + pos));
+        unsigned mask = ~whitespaceMask(v);
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 32;
+    }
+    return skipWhitespaceSse2(buffer, pos, end);
+}
+
+TARGET_AVX2 size_t findIdentifierEndAvx2(const char *buffer, size_t pos, size_t end) {
+    // most runs are short, therefore check 16 bytes first
+    if (pos + 16 <= end) {
+        size_t p = findIdentifierEndSse2(buffer, pos, pos + 16);
+        if (p < pos + 16)
+            return p;
+        pos = p;
+    }
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buffer + pos));
+        unsigned mask = whitespaceMask(v)
+            | unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(')'))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 32;
+    }
+    return findIdentifierEndSse2(buffer, pos, end);
+}
+
+TARGET_AVX2 size_t findQuoteOrEscapeAvx2(const char *buffer, size_t pos, size_t end) {
+    // most runs are short, therefore check 16 bytes first
+    if (pos + 16 <= end) {
+        size_t p = findQuoteOrEscapeSse2(buffer, pos, pos + 16);
+        if (p < pos + 16)
+            return p;
+        pos = p;
+    }
+    while (pos + 32 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buffer + pos));
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 32;
+    }
+    return findQuoteOrEscapeSse2(buffer, pos, end);
+}
+
+const Scanner avx2Scanner = {
+    skipWhitespaceAvx2,
+    findIdentifierEndAvx2,
+    findQuoteOrEscapeAvx2,
+};
+
+bool hasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // check if the OS saves the AVX registers
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SCAN_X86
+
+const Scanner *selectedScanner = &getScanner(ScanMode::SSE2);
+
+} // namespace
+
+
+ScanMode getMaxScanMode() {
+#ifdef SCAN_X86
+    static const ScanMode mode = hasAvx2() ? ScanMode::AVX2 : ScanMode::SSE2;
+    return mode;
+#else
+    return ScanMode::SCALAR;
+#endif
+}
+
+const Scanner &getScanner(ScanMode mode) {
+    // fall back to the best supported mode
+    mode = std::min(mode, getMaxScanMode());
+    switch (mode) {
+#ifdef SCAN_X86
+    case ScanMode::AVX2:
+        return avx2Scanner;
+    case ScanMode::SSE2:
+        return sse2Scanner;
+#endif
+    default:
+        return scalarScanner;
+    }
+}
+
+void setScanMode(ScanMode mode) {
+    selectedScanner = &getScanner(mode);
+}
+
+const Scanner &getScanner() {
+    return *selectedScanner;
+}
+
+namespace {
+
+template <typename T>
+bool parse(std::string_view str, T &number) {
+    // remove quotes
+    if (str.size() >= 2 && str.front() == '"' && str.back() == '"')
+        str = str.substr(1, str.size() - 2);
+
+    // std::from_chars does not accept a leading '+'
+    const char *begin = str.data();
+    const char *end = begin + str.size();
+    if (begin < end && *begin == '+')
+        ++begin;
+
+    auto result = std::from_chars(begin, end, number);
+    return result.ec == std::errc();
+}
+
+} // anonymous namespace
+
+bool parseNumber(std::string_view str, double &number) {
+    return parse(str, number);
+}
+
+bool parseNumber(std::string_view str, int &number) {
+    return parse(str, number);
+}
+
+} // namespace kicad
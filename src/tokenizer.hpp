@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+
+
+namespace kicad {
+
+/// @brief Instruction set used for scanning kicad files
+///
+enum class ScanMode {
+    // one byte at a time
+    SCALAR,
+
+    // 16 bytes at a time
+    SSE2,
+
+    // 32 bytes at a time
+    AVX2,
+};
+
+/// @brief Functions that scan a buffer from pos to end and return the position of the first byte of a class
+///
+struct Scanner {
+    // find first byte that is not whitespace
+    size_t (*skipWhitespace)(const char *buffer, size_t pos, size_t end);
+
+    // find first byte that ends an identifier (whitespace or ')')
+    size_t (*findIdentifierEnd)(const char *buffer, size_t pos, size_t end);
+
+    // find first '"' or '\\' in a quoted string
+    size_t (*findQuoteOrEscape)(const char *buffer, size_t pos, size_t end);
+};
+
+/// @brief Get the highest scan mode supported by the CPU
+ScanMode getMaxScanMode();
+
+/// @brief Get the scanner for a scan mode
+/// @param mode Scan mode, falls back to a supported mode if the CPU does not support it
+const Scanner &getScanner(ScanMode mode);
+
+/// @brief Select the scan mode of tokenizers that get constructed afterwards. Default is SSE2 if supported because
+/// most tokens are short and AVX2 does not pay off (see bom-tool-bench)
+void setScanMode(ScanMode mode);
+
+/// @brief Get the scanner of the selected scan mode
+const Scanner &getScanner();
+
+/// @brief Parse a number without allocating memory or throwing exceptions. Surrounding quotes and a leading '+' are
+/// accepted and trailing characters are ignored as with std::stod
+/// @param str String to parse, e.g. "1.27"
+/// @param number Receives the number
+/// @return true if the string starts with a number that is in range
+bool parseNumber(std::string_view str, double &number);
+
+/// @brief Parse an integer without allocating memory or throwing exceptions, see parseNumber()
+bool parseNumber(std::string_view str, int &number);
+
+
+// tokens
+enum class Token {
+    CONTAINER,
+    CONTAINER_END,
+    VALUE,
+    FILE_END,
+};
+
+
+/// @brief Splits a kicad file into tokens
+///
+class Tokenizer {
+public:
+    /// @brief Construct a tokenizer that reads from a stream through an internal buffer
+    /// @param s Input stream
+    Tokenizer(std::istream &s) : scanner(getScanner()), s(&s), buffer(this->storage) {}
+
+    /// @brief Construct a tokenizer that reads directly from memory (e.g. a memory mapped file)
+    /// @param data Data to tokenize, tokens reference the data and are not copied
+    Tokenizer(std::string_view data) : scanner(getScanner()), buffer(data.data()), end(data.size()) {}
+
+    Token getToken() {
+        if (!refill())
+            return Token::FILE_END;
+        char ch = this->buffer[this->pos];
+        if (ch == '(')
+            return Token::CONTAINER;
+        if (ch == ')')
+            return Token::CONTAINER_END;
+        return Token::VALUE;
+    }
+
+    /// @brief Read a value as number
+    /// @param number Receives the number
+    /// @return true if the value is a number
+    bool readNumber(double &number) {
+        return parseNumber(readString(), number);
+    }
+
+    std::string_view readContainer() {
+        // skip '('
+        ++this->pos;
+        return readString();
+    }
+
+    void readContainerEnd() {
+        // skip ')'
+        ++this->pos;
+    }
+
+    /// @brief Read a string or identifier.
+    /// @return Token text including quotes, valid until the next call of getToken()
+    std::string_view readString() {
+        const char *b = this->buffer;
+        size_t p = this->pos;
+        size_t e = this->end;
+
+        char ch = b[p];
+        if (ch == '"') {
+            // quoted string
+            ++p;
+            while (true) {
+                p = this->scanner.findQuoteOrEscape(b, p, e);
+                if (p >= e) {
+                    this->truncated = true;
+                    break;
+                }
+                if (b[p] == '"') {
+                    ++p;
+                    break;
+                }
+
+                // skip escaped character
+                p += 2;
+            }
+            p = std::min(p, e);
+        } else {
+            // identifier, most are short so check a few bytes before scanning
+            ++p;
+            for (int i = 0; i < 4 && p < e && b[p] != ')' && uint8_t(b[p]) > ' '; ++i)
+                ++p;
+            if (p < e && b[p] != ')' && uint8_t(b[p]) > ' ')
+                p = this->scanner.findIdentifierEnd(b, p, e);
+        }
+        std::string_view str(b + this->pos, p - this->pos);
+        this->pos = p;
+        return str;
+    }
+
+    /// @brief Skip the remaining elements of a container after its id, including the closing ')'
+    /// @return Text of the skipped elements without the closing ')', only valid when reading from memory
+    std::string_view skipContainer() {
+        size_t start = this->pos;
+        size_t end = start;
+        int depth = 1;
+        while (depth > 0) {
+            switch (getToken()) {
+            case Token::CONTAINER:
+                readContainer();
+                ++depth;
+                break;
+            case Token::CONTAINER_END:
+                end = this->pos;
+                readContainerEnd();
+                --depth;
+                break;
+            case Token::VALUE:
+                readString();
+                break;
+            case Token::FILE_END:
+                this->truncated = true;
+                return {this->buffer + start, this->pos - start};
+            }
+        }
+        return {this->buffer + start, end - start};
+    }
+
+    /// @brief Get current position in the data
+    size_t position() const {return this->pos;}
+
+    /// @brief Check if a quoted string or skipped container was cut off by the end of the data
+    bool isTruncated() const {return this->truncated;}
+
+protected:
+    bool refill() {
+        const char *b = this->buffer;
+        size_t e = this->end;
+        size_t p = this->pos;
+
+        // tokens are mostly separated by a single space, only scan longer runs of whitespace (e.g. indentation)
+        if (p < e && uint8_t(b[p]) <= ' ') {
+            ++p;
+            if (p < e && uint8_t(b[p]) <= ' ')
+                p = this->scanner.skipWhitespace(b, p, e);
+        }
+
+        size_t size = e - p;
+        if (this->s != nullptr && size < 1024) {
+            memmove(this->storage, b + p, size);
+
+            // read
+            this->s->read(this->storage + size, sizeof(this->storage) - size);
+            p = 0;
+            e = size + this->s->gcount();
+        }
+        this->pos = p;
+        this->end = e;
+        return p < e;
+    }
+
+    const Scanner &scanner;
+
+    // input stream, nullptr when reading from memory
+    std::istream *s = nullptr;
+
+    // data to tokenize, either the internal storage or external memory
+    const char *buffer;
+    size_t pos = 0;
+    size_t end = 0;
+    bool truncated = false;
+
+    char storage[2048];
+};
+
+} // namespace kicad
@@ -0,0 +1,270 @@
+#include "zip_writer.hpp"
+#include "mapped_file.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+
+
+namespace {
+
+// size of the chunks that get compressed in parallel
+constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+// size of the deflate window, each chunk gets the end of the preceding chunk as dictionary
+constexpr size_t WINDOW_SIZE = 32 * 1024;
+
+// limits of the zip format without zip64 extension
+constexpr uint64_t MAX_SIZE = 0xffffffff;
+constexpr size_t MAX_ENTRY_COUNT = 0xffff;
+
+// MS-DOS date of 1980-01-01
+constexpr uint16_t DOS_EPOCH = (1 << 5) | 1;
+
+// append little endian values to a header
+void put16(std::string &header, uint16_t value) {
+    header += char(value);
+    header += char(value >> 8);
+}
+
+void put32(std::string &header, uint32_t value) {
+    put16(header, uint16_t(value));
+    put16(header, uint16_t(value >> 16));
+}
+
+// convert to MS-DOS date and time in local time
+void toDosTime(std::filesystem::file_time_type time, uint16_t &dosTime, uint16_t &dosDate) {
+    std::time_t t = std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            std::chrono::file_clock::to_sys(time)));
+    std::tm tm = {};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+
+    // MS-DOS dates start in 1980
+    if (tm.tm_year < 80) {
+        dosTime = 0;
+        dosDate = DOS_EPOCH;
+        return;
+    }
+    dosTime = uint16_t((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1));
+    dosDate = uint16_t(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+// compress a chunk, the last chunk finishes the deflate stream, the others end on a byte boundary so that the
+// chunks can be concatenated
+bool deflateChunk(std::string_view data, std::string_view dictionary, bool last, int level, std::string &output) {
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    if (!dictionary.empty()) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()),
+            uInt(dictionary.size()));
+    }
+
+    // sync flush adds 5 bytes for the empty stored block
+    output.resize(deflateBound(&stream, uLong(data.size())) + 5);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = uInt(data.size());
+    int result;
+    while (true) {
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + stream.total_out);
+        stream.avail_out = uInt(output.size() - stream.total_out);
+        result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+
+        // the flush is only complete if deflate did not stop because the output is full
+        if (stream.avail_out != 0 || (result != Z_OK && result != Z_BUF_ERROR))
+            break;
+        output.resize(output.size() * 2);
+    }
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    // all input must be consumed, otherwise the entry would not match its CRC
+    return stream.avail_in == 0 && (last ? result == Z_STREAM_END : result == Z_OK);
+}
+
+} // anonymous namespace
+
+
+ZipWriter::ZipWriter(int level, int threadCount)
+    : level(std::clamp(level, 0, 9)), pool(threadCount)
+{
+}
+
+ZipWriter::~ZipWriter() {
+    if (this->file.is_open())
+        close();
+}
+
+bool ZipWriter::open(const std::filesystem::path &path) {
+    this->file.open(path, std::ios::binary | std::ios::trunc);
+    this->error = false;
+    this->entries.clear();
+    this->headers.clear();
+    return this->file.is_open();
+}
+
+bool ZipWriter::addFile(const std::string &name, const std::filesystem::path &path,
+    std::optional<std::filesystem::file_time_type> time)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path))
+        return false;
+    auto data = file->data();
+
+    size_t index = this->entries.size();
+    this->entries.push_back({name, data.size(), 0, {}});
+    auto &header = this->headers.emplace_back();
+    if (time) {
+        toDosTime(*time, header.dosTime, header.dosDate);
+    } else {
+        header.dosTime = 0;
+        header.dosDate = DOS_EPOCH;
+    }
+
+    // split into chunks and compress them on the thread pool
+    size_t chunkCount = std::max((data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE, size_t(1));
+    for (size_t i = 0; i < chunkCount; ++i) {
+        size_t offset = i * CHUNK_SIZE;
+        size_t size = std::min(data.size() - offset, CHUNK_SIZE);
+        bool last = i == chunkCount - 1;
+        int level = this->level;
+        auto task = std::make_shared<std::packaged_task<Chunk ()>>([file, offset, size, last, level] {
+            auto start = std::chrono::steady_clock::now();
+            auto data = file->data();
+            auto input = data.substr(offset, size);
+            Chunk chunk;
+            chunk.size = size;
+            chunk.crc = crc32(0, reinterpret_cast<const Bytef *>(input.data()), uInt(size));
+            if (level == 0) {
+                // store
+                chunk.data = input;
+            } else {
+                size_t dictionaryOffset = offset - std::min(offset, WINDOW_SIZE);
+                auto dictionary = data.substr(dictionaryOffset, offset - dictionaryOffset);
+                if (!deflateChunk(input, dictionary, last, level, chunk.data))
+                    throw std::runtime_error("deflate failed");
+            }
+            chunk.time = std::chrono::steady_clock::now() - start;
+            return chunk;
+        });
+        this->pending.push_back({task->get_future(), index, i == 0, last});
+        this->pool.submit([task] {(*task)();});
+
+        // write finished chunks to limit the memory used by compressed chunks
+        while (this->pending.size() > size_t(this->pool.size()) * 4)
+            writeChunk();
+    }
+    return true;
+}
+
+bool ZipWriter::close() {
+    while (!this->pending.empty())
+        writeChunk();
+
+    // central directory
+    uint64_t directoryOffset = this->file.tellp();
+    std::string header;
+    for (size_t i = 0; i < this->entries.size(); ++i) {
+        auto &entry = this->entries[i];
+        auto &h = this->headers[i];
+        header.clear();
+        put32(header, 0x02014b50);
+        put16(header, 20); // version made by
+        put16(header, 20); // version needed to extract
+        put16(header, 0); // flags
+        put16(header, this->level == 0 ? 0 : 8); // method: store or deflate
+        put16(header, h.dosTime);
+        put16(header, h.dosDate);
+        put32(header, h.crc);
+        put32(header, uint32_t(entry.compressedSize));
+        put32(header, uint32_t(entry.size));
+        put16(header, uint16_t(entry.name.size()));
+        put16(header, 0); // extra field length
+        put16(header, 0); // comment length
+        put16(header, 0); // disk number
+        put16(header, 0); // internal attributes
+        put32(header, 0); // external attributes
+        put32(header, uint32_t(h.offset));
+        header += entry.name;
+        this->file.write(header.data(), header.size());
+    }
+    uint64_t directorySize = uint64_t(this->file.tellp()) - directoryOffset;
+
+    // end of central directory
+    header.clear();
+    put32(header, 0x06054b50);
+    put16(header, 0); // disk number
+    put16(header, 0); // disk of central directory
+    put16(header, uint16_t(this->entries.size()));
+    put16(header, uint16_t(this->entries.size()));
+    put32(header, uint32_t(directorySize));
+    put32(header, uint32_t(directoryOffset));
+    put16(header, 0); // comment length
+    this->file.write(header.data(), header.size());
+
+    if (this->entries.size() > MAX_ENTRY_COUNT || directoryOffset > MAX_SIZE)
+        this->error = true;
+    this->file.close();
+    return !this->error && !this->file.fail();
+}
+
+void ZipWriter::writeChunk() {
+    auto pending = std::move(this->pending.front());
+    this->pending.pop_front();
+    auto &entry = this->entries[pending.entry];
+    auto &h = this->headers[pending.entry];
+
+    Chunk chunk;
+    try {
+        chunk = pending.chunk.get();
+    } catch (std::exception &) {
+        this->error = true;
+    }
+
+    if (pending.first) {
+        // local header, crc and sizes get patched when the last chunk is written
+        h.offset = this->file.tellp();
+        std::string header;
+        put32(header, 0x04034b50);
+        put16(header, 20); // version needed to extract
+        put16(header, 0); // flags
+        put16(header, this->level == 0 ? 0 : 8); // method: store or deflate
+        put16(header, h.dosTime);
+        put16(header, h.dosDate);
+        put32(header, 0); // crc
+        put32(header, 0); // compressed size
+        put32(header, 0); // uncompressed size
+        put16(header, uint16_t(entry.name.size()));
+        put16(header, 0); // extra field length
+        header += entry.name;
+        this->file.write(header.data(), header.size());
+        this->crc = chunk.crc;
+    } else {
+        this->crc = crc32_combine(this->crc, chunk.crc, z_off_t(chunk.size));
+    }
+    this->file.write(chunk.data.data(), chunk.data.size());
+    entry.compressedSize += chunk.data.size();
+    entry.time += chunk.time;
+
+    if (pending.last) {
+        h.crc = this->crc;
+        if (entry.size > MAX_SIZE || entry.compressedSize > MAX_SIZE || h.offset > MAX_SIZE)
+            this->error = true;
+
+        // patch local header
+        std::string header;
+        put32(header, h.crc);
+        put32(header, uint32_t(entry.compressedSize));
+        put32(header, uint32_t(entry.size));
+        auto end = this->file.tellp();
+        this->file.seekp(h.offset + 14);
+        this->file.write(header.data(), header.size());
+        this->file.seekp(end);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+/// @brief Zip archive writer. Files are split into chunks that get deflated in parallel on a thread pool and are
+/// streamed to the archive in order, therefore only a bounded number of chunks is held in memory. The chunk size does not
+/// depend on the number of threads, therefore the archive only depends on the added files and the compression level
+class ZipWriter {
+public:
+    /// @brief Information about a written entry
+    ///
+    struct Entry {
+        std::string name;
+        uint64_t size;
+        uint64_t compressedSize;
+
+        // time spent compressing the entry, summed over all threads
+        std::chrono::nanoseconds time;
+    };
+
+    /// @brief Constructor
+    /// @param level Compression level from 1 (fastest) to 9 (best), 0 to store without compression
+    /// @param threadCount Number of threads for compression, 0 for number of cores
+    ZipWriter(int level, int threadCount);
+
+    /// @brief Destructor, closes the archive if it is open
+    ~ZipWriter();
+
+    /// @brief Create a new archive, an existing file gets replaced
+    /// @param path Path of the archive
+    /// @return true on success
+    bool open(const std::filesystem::path &path);
+
+    /// @brief Add a file to the archive. Compression is done in the background, errors are reported by close()
+    /// @param name Name of the entry in the archive
+    /// @param path Path of the file to add
+    /// @param time Last write time that gets stored in the archive, no value for a fixed time (1980-01-01 00:00) so
+    /// that archives of the same files are identical
+    /// @return true on success, false if the file can't be read
+    bool addFile(const std::string &name, const std::filesystem::path &path,
+        std::optional<std::filesystem::file_time_type> time);
+
+    /// @brief Wait until all entries are written and write the central directory
+    /// @return true on success, false if writing failed or the archive exceeds the limits of the zip format
+    bool close();
+
+    /// @brief Get the written entries in archive order
+    /// @return Entries, complete after close()
+    const std::vector<Entry> &getEntries() const {return this->entries;}
+
+protected:
+    // compressed chunk of a file
+    struct Chunk {
+        std::string data;
+        uint32_t crc;
+        size_t size;
+        std::chrono::nanoseconds time;
+    };
+
+    // chunk that is being compressed
+    struct Pending {
+        std::future<Chunk> chunk;
+        size_t entry;
+        bool first;
+        bool last;
+    };
+
+    // entry in the central directory
+    struct Header {
+        uint16_t dosTime;
+        uint16_t dosDate;
+        uint32_t crc;
+        uint64_t offset;
+    };
+
+    // write the oldest pending chunk to the archive
+    void writeChunk();
+
+    int level;
+    ThreadPool pool;
+    std::ofstream file;
+    bool error = false;
+
+    // chunks in archive order
+    std::deque<Pending> pending;
+
+    // crc of the entry that is currently written
+    uint32_t crc = 0;
+
+    // entries and central directory headers, filled in when the last chunk of an entry is written
+    std::vector<Entry> entries;
+    std::vector<Header> headers;
+};
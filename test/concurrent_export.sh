@@ -0,0 +1,48 @@
+#!/bin/sh
+# Checks that the gerber and drill exports run concurrently and that their output and errors end up in the job log.
+# Runs bom-tool with the kicad-cli stand-in of this directory.
+# Usage: concurrent_export.sh <path to bom-tool>
+bomTool="$1"
+testDir=$(cd "$(dirname "$0")" && pwd)
+workDir=$(mktemp -d)
+trap 'rm -rf "$workDir"' EXIT
+cp "$testDir/export.kicad_pcb" "$workDir/"
+mkdir "$workDir/gerber" "$workDir/out"
+PATH="$testDir:$PATH"
+export PATH KICAD_CLI_SLEEP=2
+result=0
+
+fail() {
+    echo "FAILED: $1"
+    result=1
+}
+
+# both exports sleep 2 seconds, in sequence they would take at least 4 seconds
+start=$(date +%s)
+"$bomTool" -f -g "$workDir/export.kicad_pcb" "$workDir/out" > "$workDir/log.txt" 2>&1
+status=$?
+end=$(date +%s)
+cat "$workDir/log.txt"
+[ $status -eq 0 ] || fail "exit status $status"
+[ $((end - start)) -lt 4 ] || fail "exports did not overlap, took $((end - start)) seconds"
+for line in "gerbers stdout" "gerbers stderr" "drill stdout" "drill stderr"; do
+    grep -q "^$line\$" "$workDir/log.txt" || fail "missing output \"$line\""
+done
+[ -f "$workDir/out/export.zip" ] || fail "zip file missing"
+
+# a failing export gets reported and makes bom-tool exit with 1
+for command in drill gerbers; do
+    KICAD_CLI_SLEEP=0 KICAD_CLI_FAIL=$command "$bomTool" -f -g "$workDir/export.kicad_pcb" "$workDir/out" \
+        > "$workDir/log.txt" 2>&1
+    status=$?
+    cat "$workDir/log.txt"
+    [ $status -eq 1 ] || fail "exit status $status when $command fails"
+    case $command in
+        drill) message="Error: Drill export, kicad-cli returned result 3";;
+        gerbers) message="Error: Gerber export, kicad-cli returned result 3";;
+    esac
+    grep -q "$message" "$workDir/log.txt" || fail "missing \"$message\""
+done
+
+[ $result -eq 0 ] && echo "OK"
+exit $result
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Checks the native Excellon drill export (-e): locked through vias are drilled, blind vias are skipped with a
+# warning and oval holes are routed or written as G85 slots for JLCPCB.
+# Runs bom-tool with the kicad-cli stand-in of this directory for the gerber export.
+# Usage: native_drill.sh <path to bom-tool>
+bomTool="$1"
+testDir=$(cd "$(dirname "$0")" && pwd)
+workDir=$(mktemp -d)
+trap 'rm -rf "$workDir"' EXIT
+cp "$testDir/drill.kicad_pcb" "$workDir/"
+mkdir "$workDir/gerber" "$workDir/out"
+PATH="$testDir:$PATH"
+export PATH KICAD_CLI_SLEEP=0
+drillPath="$workDir/gerber/drill-PTH.drl"
+result=0
+
+fail() {
+    echo "FAILED: $1"
+    result=1
+}
+
+# check that a line is in the plated drill file or not
+expect() {
+    grep -qx "$2" "$drillPath"
+    found=$?
+    if [ "$1" = yes ] && [ $found -ne 0 ]; then
+        fail "missing \"$2\" in $(basename "$drillPath")"
+    elif [ "$1" = no ] && [ $found -eq 0 ]; then
+        fail "unexpected \"$2\" in $(basename "$drillPath")"
+    fi
+}
+
+"$bomTool" -f -g -e "$workDir/drill.kicad_pcb" "$workDir/out" > "$workDir/log.txt" 2>&1
+status=$?
+cat "$workDir/log.txt"
+[ $status -eq 0 ] || fail "exit status $status"
+grep -q "^Warning: 1 blind or micro vias" "$workDir/log.txt" || fail "missing warning for the blind via"
+[ -f "$workDir/gerber/drill-NPTH.drl" ] || fail "drill-NPTH.drl missing"
+expect yes "T1C0.300"
+expect yes "X10.0Y-20.0"
+expect no "X12.0Y-20.0"
+expect yes "T2C1.000"
+expect yes "G00X20.0Y-29.5"
+expect yes "G01X20.0Y-30.5"
+
+# JLCPCB gets oval holes as G85 slots
+"$bomTool" -f -g -e -j "$workDir/drill.kicad_pcb" "$workDir/out" > "$workDir/log.txt" 2>&1
+status=$?
+[ $status -eq 0 ] || fail "exit status $status for JLCPCB"
+expect yes "X10.0Y-20.0"
+expect yes "X20.0Y-29.5G85X20.0Y-30.5"
+
+[ $result -eq 0 ] && echo "OK"
+exit $result